@@ -3,6 +3,12 @@
 #include "esphome/core/application.h"
 #include "esphome/core/helpers.h"
 
+#ifdef USE_ESP32
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <soc/soc_memory_layout.h>
+#endif
+
 namespace esphome {
 namespace it8951e {
 
@@ -53,6 +59,10 @@ static const char *const TAG = "it8951e";
 #define IT8951_MODE_2   2
 #define IT8951_MODE_3   3
 #define IT8951_MODE_4   4
+#define IT8951_MODE_INIT IT8951_MODE_0
+#define IT8951_MODE_DU   IT8951_MODE_1
+#define IT8951_MODE_GC16 IT8951_MODE_2
+#define IT8951_MODE_GL16 IT8951_MODE_3
 //Endian Type
 #define IT8951_LDIMG_L_ENDIAN   0
 #define IT8951_LDIMG_B_ENDIAN   1
@@ -76,131 +86,2663 @@ static const char *const TAG = "it8951e";
 //Update Parameter Setting Register
 #define UP0SR (DISPLAY_REG_BASE + 0x134)      //Update Parameter0 Setting Reg
 
-#define UP1SR     (DISPLAY_REG_BASE + 0x138)  //Update Parameter1 Setting Reg
-#define LUT0ABFRV (DISPLAY_REG_BASE + 0x13C)  //LUT0 Alpha blend and Fill rectangle Value
-#define UPBBADDR  (DISPLAY_REG_BASE + 0x17C)  //Update Buffer Base Address
-#define LUT0IMXY  (DISPLAY_REG_BASE + 0x180)  //LUT0 Image buffer X/Y offset Reg
-#define LUTAFSR   (DISPLAY_REG_BASE + 0x224)  //LUT Status Reg (status of All LUT Engines)
+#define UP1SR     (DISPLAY_REG_BASE + 0x138)  //Update Parameter1 Setting Reg
+#define LUT0ABFRV (DISPLAY_REG_BASE + 0x13C)  //LUT0 Alpha blend and Fill rectangle Value
+#define UPBBADDR  (DISPLAY_REG_BASE + 0x17C)  //Update Buffer Base Address
+#define LUT0IMXY  (DISPLAY_REG_BASE + 0x180)  //LUT0 Image buffer X/Y offset Reg
+#define LUTAFSR   (DISPLAY_REG_BASE + 0x224)  //LUT Status Reg (status of All LUT Engines)
+
+#define BGVR      (DISPLAY_REG_BASE + 0x250)  //Bitmap (1bpp) image color table
+//-------System Registers----------------
+#define SYS_REG_BASE 0x0000
+
+//Address of System Registers
+#define I80CPCR (SYS_REG_BASE + 0x04)
+//-------Memory Converter Registers----------------
+#define MCSR_BASE_ADDR 0x0200
+#define MCSR (MCSR_BASE_ADDR  + 0x0000)
+#define LISAR (MCSR_BASE_ADDR + 0x0008)
+
+#define SYS_REG_BASE 0x0000
+#define I80CPCR (SYS_REG_BASE + 0x04)
+
+#define USDEF_I80_CMD_GET_DEV_INFO 0x0302
+
+#define IT8951_TCON_REG_WR       0x0011
+
+
+void it8951e::setup_pins_() {
+//   this->cs_pin_->setup();  // OUTPUT
+//   this->cs_pin_->digital_write(false);
+  if (this->reset_pin_ != nullptr) {
+    this->reset_pin_->setup();  // OUTPUT
+    this->reset_pin_->digital_write(true);
+  }
+  if (this->busy_pin_ != nullptr) {
+    this->busy_pin_->setup();  // INPUT
+    this->busy_pin_->attach_interrupt(&it8951e::hrdy_isr_, this, gpio::INTERRUPT_RISING_EDGE);
+  }
+  if (this->en_pin_ != nullptr) {
+    this->en_pin_->setup();  // OUTPUT
+    this->en_pin_->digital_write(true);
+  }
+  this->write_data_rate_ = this->data_rate_;
+  this->spi_setup();
+  this->apply_spi_rates_();
+
+  // Burst writes are staged here so the SPI driver can send a whole chunk per call
+  this->transfer_chunk_size_ &= ~1u;
+#ifdef USE_ESP32
+  uint32_t caps = this->dma_buffer_ ? MALLOC_CAP_DMA : (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  this->transfer_buffer_ = (uint8_t *) heap_caps_malloc(this->transfer_chunk_size_, caps);
+#else
+  this->transfer_buffer_ = (uint8_t *) malloc(this->transfer_chunk_size_);  // NOLINT
+#endif
+  if (this->transfer_buffer_ == nullptr) {
+    ESP_LOGW(TAG, "Could not allocate %u byte transfer buffer, falling back to word writes",
+             this->transfer_chunk_size_);
+  }
+}
+
+#ifdef USE_ESP32
+//-----------------------------------------------------------
+// Warm wake
+//  Device info, the tested SPI clock and the ghosting counter are kept
+//  in RTC memory while the ESP32 deep sleeps. If the controller was
+//  put to sleep instead of losing power it still has its registers,
+//  which I80CPCR (set to packed mode by us) tells apart from a reset.
+//-----------------------------------------------------------
+static const uint32_t RTC_STATE_MAGIC = 0x49543839;
+
+struct RtcState {
+  uint32_t magic;
+  IT8951DevInfo dev_info;
+  uint32_t write_data_rate;
+  uint32_t partial_updates;
+};
+static RTC_DATA_ATTR RtcState rtc_state;
+#endif
+
+bool it8951e::restore_from_sleep_() {
+#ifdef USE_ESP32
+  if (rtc_state.magic != RTC_STATE_MAGIC)
+    return false;
+  //Only trusted once, deep_sleep() stores it again
+  rtc_state.magic = 0;
+  if (rtc_state.write_data_rate != 0) {
+    this->write_data_rate_ = rtc_state.write_data_rate;
+    if (this->read_data_rate_ > this->write_data_rate_)
+      this->read_data_rate_ = this->write_data_rate_;
+    this->apply_spi_rates_();
+  }
+  this->wake();
+  if (this->IT8951ReadReg(I80CPCR) != 0x0001) {
+    ESP_LOGD(TAG, "Controller lost its state while asleep, doing a full init");
+    return false;
+  }
+  this->gstI80DevInfo = rtc_state.dev_info;
+  this->partial_updates_ = rtc_state.partial_updates;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void it8951e::store_for_sleep_() {
+#ifdef USE_ESP32
+  rtc_state.dev_info = this->gstI80DevInfo;
+  rtc_state.write_data_rate = this->write_data_rate_;
+  rtc_state.partial_updates = this->partial_updates_;
+  rtc_state.magic = RTC_STATE_MAGIC;
+#endif
+}
+
+//-----------------------------------------------------------
+// Controller power states
+//  STANDBY stops the clocks between refreshes, SLEEP also powers the
+//  panel driver down. Any command wakes the controller with SYS_RUN.
+//-----------------------------------------------------------
+void it8951e::wake() {
+  this->controller_state_ = CONTROLLER_RUNNING;
+  this->LCDWriteCmdCode(IT8951_TCON_SYS_RUN);
+}
+
+void it8951e::standby() {
+  if (this->lut_busy_)
+    this->IT8951WaitForDisplayReady();
+  this->LCDWriteCmdCode(IT8951_TCON_STANDBY);
+  this->controller_state_ = CONTROLLER_STANDBY;
+}
+
+void it8951e::deep_sleep() {
+  if (this->gstI80DevInfo.usPanelW == 0)
+    return;
+  //The pipeline task may still own the bus, then the LUT engines have to finish
+  for (int i = 0; this->pipeline_busy_ && i < this->idle_timeout_(); i++)
+    delay(1);
+  if (this->pipeline_busy_) {
+    ESP_LOGW(TAG, "Display task still busy, not going to sleep");
+    return;
+  }
+  if (this->lut_busy_)
+    this->IT8951WaitForDisplayReady();
+  this->LCDWriteCmdCode(IT8951_TCON_SLEEP);
+  this->controller_state_ = CONTROLLER_SLEEP;
+  this->store_for_sleep_();
+  ESP_LOGD(TAG, "Controller sleeping");
+}
+
+void it8951e::initialize() {
+  this->build_gray_luts_();
+
+  //A controller we put to sleep ourselves is still set up, skip the reset and the device info read
+  const bool warm = this->restore_from_sleep_();
+  if (!warm) {
+    this->reset_();
+    this->controller_state_ = CONTROLLER_RUNNING;
+
+    //Get Device Info
+    this->GetIT8951SystemInfo();
+  }
+
+  if (!this->gstI80DevInfo.usPanelW || !this->gstI80DevInfo.usPanelH) {
+    return;
+  }
+
+  this->gulImgBufAddr = this->gstI80DevInfo.usImgBufAddrL | ((uint32_t)this->gstI80DevInfo.usImgBufAddrH << 16);
+
+  //A2 sits at a different waveform index on the 6" M641 LUT
+  this->a2_mode_ = strncmp((const char*)this->gstI80DevInfo.usLUTVersion, "M641", 4) == 0 ? 4 : 6;
+
+  //Let the controller rotate while loading so the host always renders in native row order.
+  //1bpp is loaded as 8bpp bytes of 8 pixels each, which the controller can't rotate.
+  this->width_ = this->gstI80DevInfo.usPanelW;
+  this->height_ = this->gstI80DevInfo.usPanelH;
+  if (this->bits_per_pixel_ != 1 && this->rotation_ != display::DISPLAY_ROTATION_0_DEGREES) {
+    switch (this->rotation_) {
+      case display::DISPLAY_ROTATION_90_DEGREES:
+        this->hw_rotate_ = IT8951_ROTATE_90;
+        break;
+      case display::DISPLAY_ROTATION_180_DEGREES:
+        this->hw_rotate_ = IT8951_ROTATE_180;
+        break;
+      default:
+        this->hw_rotate_ = IT8951_ROTATE_270;
+        break;
+    }
+    this->rotation_ = display::DISPLAY_ROTATION_0_DEGREES;
+  }
+  if (this->hw_rotate_ == IT8951_ROTATE_90 || this->hw_rotate_ == IT8951_ROTATE_270)
+    std::swap(this->width_, this->height_);
+
+  //Frame buffer size depends on the panel reported by the controller, rows are padded to whole words
+  this->pitch_ = ((this->width_ * this->bits_per_pixel_ + 15) / 16) * 2;
+  this->frame_y0_ = 0;
+  this->frame_rows_ = this->height_;
+  if (this->tile_pool_size_ != 0 && this->band_height_ == 0)
+    this->band_height_ = TILE_SIZE * 4;
+  if (this->band_height_ != 0) {
+    //Only one strip is kept on the host, the controller holds the frame
+    this->frame_rows_ = std::min<uint16_t>(this->band_height_, this->height_);
+    //Tiles are hashed, decoded and stored from whole bands
+    if (this->tile_pool_size_ != 0 || this->frame_diff_)
+      this->frame_rows_ = std::min<uint16_t>((this->band_height_ + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE, this->height_);
+    if (this->double_buffer_)
+      ESP_LOGW(TAG, "Banded rendering disables double buffering");
+    this->double_buffer_ = false;
+  }
+  if (this->buffer_ == nullptr)
+    this->init_internal_(this->get_buffer_length_());
+
+  //Waveforms: which tiles last got a grayscale image, the first update is always a full GC16
+  this->tiles_x_ = (this->width_ + TILE_SIZE - 1) / TILE_SIZE;
+  this->tiles_y_ = (this->height_ + TILE_SIZE - 1) / TILE_SIZE;
+  this->gray_tiles_.assign(this->tiles_x_ * this->tiles_y_, true);
+  if (this->cleanup_threshold_ != 0)
+    this->ghost_counts_.assign(this->tiles_x_ * this->tiles_y_, 0);
+  if (this->frame_diff_) {
+    this->tile_hashes_.assign(this->tiles_x_ * this->tiles_y_, 0);
+    this->changed_tiles_.assign(this->tiles_x_ * this->tiles_y_, false);
+  }
+  if (this->tile_pool_size_ != 0 && this->frame_tiles_.empty()) {
+    if (this->tile_pool_.init(this->tile_pool_size_)) {
+      this->frame_tiles_.assign(this->tiles_x_ * this->tiles_y_, FrameTile{TILE_UNKNOWN, 0, 0, TILE_BLOCK_NONE});
+      this->changed_tiles_.assign(this->tiles_x_ * this->tiles_y_, false);
+      this->tile_raw_.resize(TILE_SIZE * TILE_SIZE * this->bits_per_pixel_ / 8);
+      this->tile_packed_.resize(this->tile_raw_.size());
+    } else {
+      ESP_LOGE(TAG, "Could not allocate %u byte tile pool, rendering in plain bands", this->tile_pool_size_);
+    }
+  }
+  //Regions map to whole tiles, a tile belongs to the last region covering its center
+  if (!this->regions_.empty() && this->band_height_ == 0 && !this->double_buffer_) {
+    this->tile_regions_.assign(this->tiles_x_ * this->tiles_y_, 0);
+    for (uint8_t id = 1; id <= this->regions_.size(); id++) {
+      const DirtyArea &area = this->regions_[id - 1].area;
+      for (uint16_t ty = 0; ty < this->tiles_y_; ty++) {
+        for (uint16_t tx = 0; tx < this->tiles_x_; tx++) {
+          const int cx = tx * TILE_SIZE + TILE_SIZE / 2, cy = ty * TILE_SIZE + TILE_SIZE / 2;
+          if (cx >= area.x0 && cx <= area.x1 && cy >= area.y0 && cy <= area.y1)
+            this->tile_regions_[ty * this->tiles_x_ + tx] = id;
+        }
+      }
+    }
+  } else if (!this->regions_.empty()) {
+    ESP_LOGW(TAG, "Update regions need a full frame buffer without double buffering, ignoring them");
+    this->regions_.clear();
+  }
+  //After a warm wake the panel still shows the frame in controller memory, no flashing full refresh needed
+  this->force_full_update_ = !warm;
+
+  //Controller memory may have been reset, forget everything cached there
+  this->clear_image_cache();
+  for (auto &placed : this->placed_assets_)
+    placed.stale = true;
+
+  if (this->double_buffer_)
+    this->start_pipeline_();
+
+  //Set to Enable I80 Packed mode
+  this->IT8951WriteReg(I80CPCR, 0x0001);
+
+  if (this->bits_per_pixel_ == 1) {
+    //1bpp images are loaded as 8bpp and expanded through the BGVR color table
+    this->IT8951WriteReg(UP1SR + 2, this->IT8951ReadReg(UP1SR + 2) | (1 << 2));
+    this->IT8951WriteReg(BGVR, (0x00 << 8) | 0xF0);
+  }
+
+  if (this->spi_self_test_ && !warm)
+    this->run_spi_self_test_();
+  this->flush_commands_();
+  ESP_LOGD(TAG, "Initialized after %s", warm ? "a warm wake" : "a reset");
+}
+
+//-----------------------------------------------------------
+// SPI clock selection
+//  Writes run at data_rate on this device. Reads at another clock go
+//  through a second device on the same bus and CS pin, so nothing is
+//  re-registered per transaction, only when the clocks change.
+//-----------------------------------------------------------
+void it8951e::apply_spi_rates_() {
+  if (this->write_data_rate_ != 0 && this->write_data_rate_ != this->data_rate_) {
+    this->spi_teardown();
+    this->set_data_rate(this->write_data_rate_);
+    this->spi_setup();
+  }
+  const uint32_t read_rate = this->read_data_rate_ != this->write_data_rate_ ? this->read_data_rate_ : 0;
+  if (read_rate == this->reader_rate_)
+    return;
+  if (this->reader_rate_ != 0)
+    this->reader_.spi_teardown();
+  this->reader_rate_ = read_rate;
+  if (read_rate == 0)
+    return;
+  this->reader_.set_spi_parent(this->parent_);
+  this->reader_.set_cs_pin(this->cs_);
+  this->reader_.set_data_rate(read_rate);
+  this->reader_.spi_setup();
+}
+
+bool it8951e::check_spi_readback_() {
+  //Scratch words right behind the displayed image, nothing else lives there
+  static const uint16_t PATTERNS[] = {0x0000, 0xFFFF, 0xAAAA, 0x5555, 0x00FF, 0xFF00, 0x1234, 0xEDCB};
+  static const uint32_t WORDS = SPI_SELF_TEST_WORDS;
+  const uint32_t ulAddr = this->get_scratch_addr_();
+  uint16_t usWrite[WORDS];
+  uint16_t usRead[WORDS];
+  for (uint32_t i = 0; i < WORDS; i++)
+    usWrite[i] = PATTERNS[i % 8] ^ (i * 0x0101);
+
+  this->IT8951MemBurstWriteProc(ulAddr, WORDS, usWrite);
+  this->IT8951MemBurstReadProc(ulAddr, WORDS, usRead);
+
+  for (uint32_t i = 0; i < WORDS; i++) {
+    if (usRead[i] != usWrite[i]) {
+      ESP_LOGW(TAG, "SPI readback mismatch at word %u: wrote 0x%04X, read 0x%04X", i, usWrite[i], usRead[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+void it8951e::run_spi_self_test_() {
+  //Halve the write clock until the controller reads back what was written
+  while (!this->check_spi_readback_()) {
+    const uint32_t slower = this->write_data_rate_ / 2;
+    if (slower < spi::DATA_RATE_1MHZ) {
+      ESP_LOGE(TAG, "SPI self-test failed even at %u Hz, check wiring", this->write_data_rate_);
+      this->status_set_warning();
+      return;
+    }
+    ESP_LOGW(TAG, "SPI self-test failed at %u Hz, retrying at %u Hz", this->write_data_rate_, slower);
+    this->write_data_rate_ = slower;
+    if (this->read_data_rate_ > slower)
+      this->read_data_rate_ = slower;
+    this->apply_spi_rates_();
+  }
+  ESP_LOGI(TAG, "SPI self-test passed, writing at %u Hz, reading at %u Hz", this->write_data_rate_,
+           this->read_data_rate_ != 0 ? this->read_data_rate_ : this->write_data_rate_);
+}
+
+void it8951e::enablePower() { this->en_pin_->digital_write(true); }
+void it8951e::disablePower() { this->en_pin_->digital_write(false); }
+
+float it8951e::get_setup_priority() const { return setup_priority::PROCESSOR; }
+
+static void log_summary(const char *name, const TimingSummary &summary, const char *unit) {
+  if (summary.count == 0)
+    return;
+  ESP_LOGCONFIG(TAG, "  %s: min %u %s, avg %u %s, max %u %s (%u updates)", name, summary.min, unit,
+                (uint32_t) (summary.sum / summary.count), unit, summary.max, unit, summary.count);
+}
+
+void it8951e::dump_config() {
+  LOG_DISPLAY("", "IT8951E", this);
+  ESP_LOGCONFIG(TAG, "  Panel: %ux%u", this->gstI80DevInfo.usPanelW, this->gstI80DevInfo.usPanelH);
+  ESP_LOGCONFIG(TAG, "  Hardware Rotation: %u", this->hw_rotate_ * 90);
+  ESP_LOGCONFIG(TAG, "  Bits Per Pixel: %u", this->bits_per_pixel_);
+  ESP_LOGCONFIG(TAG, "  Double Buffer: %s", YESNO(this->double_buffer_));
+  if (this->band_height_ != 0)
+    ESP_LOGCONFIG(TAG, "  Band Height: %u rows (%u bytes)", this->frame_rows_, this->get_buffer_length_());
+  if (!this->frame_tiles_.empty())
+    ESP_LOGCONFIG(TAG, "  Tile Pool: %u of %u blocks free, %u tiles", this->tile_pool_.get_free_count(),
+                  this->tile_pool_.get_block_count(), (uint32_t) this->frame_tiles_.size());
+  ESP_LOGCONFIG(TAG, "  Frame Diff: %s", YESNO(this->frame_diff_));
+  ESP_LOGCONFIG(TAG, "  Glyph Cache: %u bytes", this->glyph_cache_size_);
+  ESP_LOGCONFIG(TAG, "  Dither: %s",
+                this->dither_ == DITHER_BAYER             ? "Bayer"
+                : this->dither_ == DITHER_FLOYD_STEINBERG ? "Floyd-Steinberg"
+                                                          : "None");
+  ESP_LOGCONFIG(TAG, "  Data Rate: %u Hz write, %u Hz read", this->write_data_rate_,
+                this->read_data_rate_ != 0 ? this->read_data_rate_ : this->write_data_rate_);
+  ESP_LOGCONFIG(TAG, "  Transfer Chunk Size: %u bytes%s", this->transfer_chunk_size_,
+                this->dma_buffer_ ? " (DMA)" : "");
+  ESP_LOGCONFIG(TAG, "  Full Update Every: %u", this->full_update_every_);
+  if (this->cleanup_threshold_ != 0)
+    ESP_LOGCONFIG(TAG, "  Ghosting Cleanup: after %u fast refreshes, %u ms idle", this->cleanup_threshold_,
+                  this->cleanup_delay_);
+  ESP_LOGCONFIG(TAG, "  Binary Waveform: %s",
+                this->binary_waveform_ == BINARY_WAVEFORM_A2   ? "A2"
+                : this->binary_waveform_ == BINARY_WAVEFORM_DU ? "DU"
+                                                               : "GC16");
+  LOG_PIN("  Reset Pin: ", this->reset_pin_);
+  LOG_PIN("  Busy Pin: ", this->busy_pin_);
+  ESP_LOGCONFIG(TAG, "  Busy Backoff: %u ms", this->busy_backoff_);
+  ESP_LOGCONFIG(TAG, "  Idle Standby: %s", YESNO(this->idle_standby_));
+#ifdef USE_IT8951E_INK
+  if (this->ink_touchscreen_ != nullptr)
+    ESP_LOGCONFIG(TAG, "  Ink: %u px pen, A2 waveform %u", this->ink_pen_size_, this->a2_mode_);
+#endif
+  ESP_LOGCONFIG(TAG, "  Update Window: %u ms", this->update_window_);
+  ESP_LOGCONFIG(TAG, "  Min Refresh Interval: %u ms", this->background_region_.min_interval);
+  for (const auto &region : this->regions_) {
+    ESP_LOGCONFIG(TAG, "  Region %d,%d-%d,%d: min interval %u ms%s", region.area.x0, region.area.y0, region.area.x1,
+                  region.area.y1, region.min_interval, region.priority ? ", priority" : "");
+  }
+  LOG_UPDATE_INTERVAL(this);
+  log_summary("Render", this->render_summary_, "us");
+  log_summary("Pack", this->pack_summary_, "us");
+  log_summary("Transfer", this->transfer_summary_, "us");
+  log_summary("Bytes Sent", this->bytes_summary_, "B");
+  log_summary("Busy Wait", this->busy_summary_, "us");
+  log_summary("LUT", this->lut_summary_, "ms");
+#ifdef USE_SENSOR
+  LOG_SENSOR("  ", "Render Time", this->render_time_sensor_);
+  LOG_SENSOR("  ", "Pack Time", this->pack_time_sensor_);
+  LOG_SENSOR("  ", "Transfer Time", this->transfer_time_sensor_);
+  LOG_SENSOR("  ", "Bytes Sent", this->bytes_sent_sensor_);
+  LOG_SENSOR("  ", "Busy Wait Time", this->busy_wait_time_sensor_);
+  LOG_SENSOR("  ", "LUT Time", this->lut_time_sensor_);
+#endif
+}
+
+void it8951e::update() {
+  //Requests within update_window_ of the first one are drawn together from loop()
+  if (this->update_window_ != 0) {
+    if (!this->update_requested_) {
+      this->update_requested_ = true;
+      this->update_due_ = millis() + this->update_window_;
+    }
+    return;
+  }
+  this->render_update_();
+}
+
+void it8951e::render_update_() {
+  if (this->band_height_ != 0) {
+    //Strips go to image memory as they are drawn, so an update min_refresh_interval holds back isn't drawn yet
+    const uint32_t now = millis();
+    const uint32_t wait = this->region_wait_(this->background_region_, now);
+    if (wait != 0) {
+      this->update_requested_ = true;
+      this->update_due_ = now + wait;
+      return;
+    }
+  }
+  //Cached images and assets stay up as long as the writer keeps showing them
+  for (auto &blit : this->cached_blits_)
+    blit.wanted = false;
+  for (auto &placed : this->placed_assets_)
+    placed.wanted = false;
+  if (this->band_height_ != 0) {
+    this->update_banded_();
+    return;
+  }
+  const uint32_t start = micros();
+  this->do_update_();
+  this->render_timings_.render_us = micros() - start;
+  this->display();
+}
+
+//-----------------------------------------------------------
+// Banded rendering
+//  The writer runs once per horizontal strip with the strip as clipping
+//  rectangle, so the host only ever holds band_height_ rows. With the
+//  frame diff each strip is hashed tile by tile against what was last
+//  sent and only changed tiles are uploaded and refreshed. Without it
+//  the whole strip is uploaded and the refresh covers everything that
+//  was marked dirty over all strips.
+//-----------------------------------------------------------
+void it8951e::update_banded_() {
+  if (this->buffer_ == nullptr)
+    return;
+  //Strips go straight into image memory the LUT engines may still be reading
+  if (this->lut_busy_)
+    this->IT8951WaitForDisplayReady();
+
+  const uint8_t background = this->replicate_value_(this->get_pixel_value_(display::COLOR_OFF));
+  const bool tiled = !this->frame_tiles_.empty();
+  const bool diffed = tiled || this->frame_diff_;
+  //Only without auto clear the writer draws on top of the previous frame, which only the tile pool keeps
+  const bool redraw = tiled && !this->auto_clear_enabled_;
+  const ProtocolStats before = this->stats_;
+  this->hrdy_wait_us_ = 0;
+  this->render_timings_ = {};
+  bool binary = true;
+  for (int y = 0; y < this->height_; y += this->frame_rows_) {
+    const uint16_t rows = std::min<int>(this->frame_rows_, this->height_ - y);
+    this->frame_y0_ = y;
+    if (redraw) {
+      //What the writer marks dirty tells whether the band can change
+      const uint32_t decode_start = micros();
+      this->decode_band_(y, rows);
+      this->render_timings_.pack_us += micros() - decode_start;
+      this->dirty_count_ = 0;
+    } else if (!this->auto_clear_enabled_) {
+      memset(this->buffer_, background, rows * this->pitch_);
+    }
+    //Clipping is in rotated coordinates, software rotation relies on the row check alone
+    if (this->rotation_ == display::DISPLAY_ROTATION_0_DEGREES)
+      this->start_clipping(0, y, this->width_, y + rows);
+    const uint32_t render_start = micros();
+    this->do_update_();
+    //The writer shows the same images and assets in every strip, the areas of those it dropped go out with the strips
+    if (y == 0)
+      this->settle_blits_();
+    const uint32_t transfer_start = micros();
+    this->render_timings_.render_us += transfer_start - render_start;
+
+    if (diffed) {
+      //A cleared band may differ from what was sent even where nothing was drawn
+      binary = this->store_band_(y, rows, !redraw || this->dirty_count_ != 0) && binary;
+      this->render_timings_.transfer_us += micros() - transfer_start;
+      continue;
+    }
+    const DirtyArea strip = {0, (int16_t) y, (int16_t) (this->width_ - 1), (int16_t) (y + rows - 1)};
+    this->upload_frame_(this->buffer_, strip);
+    this->render_timings_.transfer_us += micros() - transfer_start;
+    binary = binary && this->is_binary_area_(this->buffer_, strip);
+  }
+  this->frame_y0_ = 0;
+  //Only the tiles that actually changed get refreshed
+  if (diffed)
+    this->mark_changed_tiles_();
+  this->render_timings_.bytes = this->stats_.bytes_written - before.bytes_written;
+  this->render_timings_.busy_us = this->hrdy_wait_us_;
+  this->frame_timings_ = this->render_timings_;
+  this->timings_ready_ = true;
+
+  if (this->dirty_count_ == 0) {
+    this->flush_direct_updates_();
+    return;
+  }
+  this->coalesce_dirty_();
+  this->band_binary_ = binary;
+  this->background_region_.refreshed = true;
+  this->background_region_.last_refresh = millis();
+  this->refresh_areas_(nullptr, this->dirty_areas_, this->dirty_count_);
+  this->dirty_count_ = 0;
+}
+
+//-----------------------------------------------------------
+// Tile compressed frame
+//  With a tile pool the whole frame is kept on the host as well, as
+//  TILE_SIZE x TILE_SIZE tiles that are uniform (one byte), RLE or raw.
+//  Blocks come from a fixed pool, nothing is allocated per update.
+//  Without auto clear each band is decoded from the tiles before the
+//  writer draws on it. Afterwards tiles are hashed against what was
+//  sent, only those whose hash changed are encoded into the pool,
+//  uploaded and refreshed.
+//-----------------------------------------------------------
+bool TilePool::init(uint32_t size) {
+  this->block_count_ = std::min<uint32_t>(size / TILE_BLOCK_SIZE, TILE_BLOCK_NONE);
+  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+  this->data_ = allocator.allocate(this->block_count_ * TILE_BLOCK_SIZE);
+  if (this->data_ == nullptr) {
+    this->block_count_ = 0;
+    return false;
+  }
+  //Every block starts on the free list
+  this->next_.resize(this->block_count_);
+  for (uint16_t i = 0; i < this->block_count_; i++)
+    this->next_[i] = i + 1 < this->block_count_ ? i + 1 : TILE_BLOCK_NONE;
+  this->free_ = this->block_count_ > 0 ? 0 : TILE_BLOCK_NONE;
+  this->free_count_ = this->block_count_;
+  return true;
+}
+
+uint16_t TilePool::store(const uint8_t *data, uint16_t length) {
+  const uint16_t needed = (length + TILE_BLOCK_SIZE - 1) / TILE_BLOCK_SIZE;
+  if (needed == 0 || needed > this->free_count_)
+    return TILE_BLOCK_NONE;
+  //Take the chain straight off the head of the free list
+  const uint16_t first = this->free_;
+  uint16_t block = first;
+  for (uint16_t i = 0; i < needed; i++) {
+    const uint16_t n = std::min<uint16_t>(length, TILE_BLOCK_SIZE);
+    memcpy(this->data_ + block * TILE_BLOCK_SIZE, data, n);
+    data += n;
+    length -= n;
+    if (i + 1 < needed)
+      block = this->next_[block];
+  }
+  this->free_ = this->next_[block];
+  this->next_[block] = TILE_BLOCK_NONE;
+  this->free_count_ -= needed;
+  return first;
+}
+
+void TilePool::release(uint16_t block) {
+  while (block != TILE_BLOCK_NONE) {
+    const uint16_t next = this->next_[block];
+    this->next_[block] = this->free_;
+    this->free_ = block;
+    this->free_count_++;
+    block = next;
+  }
+}
+
+void TilePool::read(uint16_t block, uint8_t *out, uint16_t length) const {
+  for (; length > 0 && block != TILE_BLOCK_NONE; block = this->next_[block]) {
+    const uint16_t n = std::min<uint16_t>(length, TILE_BLOCK_SIZE);
+    memcpy(out, this->data_ + block * TILE_BLOCK_SIZE, n);
+    out += n;
+    length -= n;
+  }
+}
+
+bool TilePool::equals(uint16_t block, const uint8_t *data, uint16_t length) const {
+  for (; length > 0 && block != TILE_BLOCK_NONE; block = this->next_[block]) {
+    const uint16_t n = std::min<uint16_t>(length, TILE_BLOCK_SIZE);
+    if (memcmp(this->data_ + block * TILE_BLOCK_SIZE, data, n) != 0)
+      return false;
+    data += n;
+    length -= n;
+  }
+  return length == 0;
+}
+
+// Same format as flash assets. Returns 0 unless the result is shorter than the input.
+static uint16_t rle_encode(const uint8_t *src, uint16_t length, uint8_t *dst) {
+  uint16_t out = 0;
+  uint16_t i = 0;
+  while (i < length) {
+    uint16_t run = 1;
+    while (i + run < length && run < 128 && src[i + run] == src[i])
+      run++;
+    if (run >= 3) {
+      if (out + 2 >= length)
+        return 0;
+      dst[out++] = 0x80 | (run - 1);
+      dst[out++] = src[i];
+      i += run;
+      continue;
+    }
+    const uint16_t start = i;
+    while (i < length && i - start < 128) {
+      if (i + 2 < length && src[i] == src[i + 1] && src[i] == src[i + 2])
+        break;
+      i++;
+    }
+    if (out + 1 + (i - start) >= length)
+      return 0;
+    dst[out++] = i - start - 1;
+    memcpy(dst + out, src + start, i - start);
+    out += i - start;
+  }
+  return out;
+}
+
+static void rle_decode(const uint8_t *src, uint16_t length, uint8_t *dst) {
+  const uint8_t *end = src + length;
+  while (src < end) {
+    const uint8_t control = *src++;
+    const uint16_t count = (control & 0x7F) + 1;
+    if (control & 0x80) {
+      memset(dst, *src++, count);
+    } else {
+      memcpy(dst, src, count);
+      src += count;
+    }
+    dst += count;
+  }
+}
+
+void it8951e::get_tile_span_(uint16_t tx, uint16_t ty, uint32_t &x0, uint32_t &row_bytes, uint16_t &y0,
+                             uint16_t &rows) {
+  //Same bytes hash_tile_() covers, the last column and row of tiles may be cut short
+  x0 = tx * TILE_SIZE * this->bits_per_pixel_ / 8;
+  row_bytes = std::min<uint32_t>(TILE_SIZE * this->bits_per_pixel_ / 8, this->pitch_ - x0);
+  y0 = ty * TILE_SIZE;
+  rows = std::min<uint16_t>(TILE_SIZE, this->height_ - y0);
+}
+
+uint16_t it8951e::gather_tile_(uint16_t tx, uint16_t ty) {
+  uint32_t x0, row_bytes;
+  uint16_t y0, rows;
+  this->get_tile_span_(tx, ty, x0, row_bytes, y0, rows);
+  const uint8_t *src = this->buffer_ + (y0 - this->frame_y0_) * this->pitch_ + x0;
+  uint8_t *dst = this->tile_raw_.data();
+  for (uint16_t y = 0; y < rows; y++, src += this->pitch_, dst += row_bytes)
+    memcpy(dst, src, row_bytes);
+  return rows * row_bytes;
+}
+
+void it8951e::scatter_tile_(uint16_t tx, uint16_t ty) {
+  uint32_t x0, row_bytes;
+  uint16_t y0, rows;
+  this->get_tile_span_(tx, ty, x0, row_bytes, y0, rows);
+  const uint8_t *src = this->tile_raw_.data();
+  uint8_t *dst = this->buffer_ + (y0 - this->frame_y0_) * this->pitch_ + x0;
+  for (uint16_t y = 0; y < rows; y++, src += row_bytes, dst += this->pitch_)
+    memcpy(dst, src, row_bytes);
+}
+
+bool it8951e::store_tile_(uint32_t index, uint16_t length) {
+  //Encodes tile_raw_, returns whether the tile differs from what was stored before
+  FrameTile &tile = this->frame_tiles_[index];
+  const uint8_t *raw = this->tile_raw_.data();
+  FrameTile encoded = {TILE_UNIFORM, raw[0], 0, TILE_BLOCK_NONE};
+  const uint8_t *data = nullptr;
+  if (std::any_of(raw + 1, raw + length, [raw](uint8_t b) { return b != raw[0]; })) {
+    encoded.length = rle_encode(raw, length, this->tile_packed_.data());
+    encoded.kind = encoded.length != 0 ? TILE_RLE : TILE_RAW;
+    encoded.value = 0;
+    if (encoded.length == 0)
+      encoded.length = length;
+    data = encoded.kind == TILE_RLE ? this->tile_packed_.data() : raw;
+  }
+
+  if (tile.kind == encoded.kind && tile.value == encoded.value && tile.length == encoded.length &&
+      (data == nullptr || this->tile_pool_.equals(tile.block, data, encoded.length)))
+    return false;
+
+  this->tile_pool_.release(tile.block);
+  if (data != nullptr) {
+    encoded.block = this->tile_pool_.store(data, encoded.length);
+    if (encoded.block == TILE_BLOCK_NONE) {
+      //Still sent this time, but drawn again from the background next update
+      ESP_LOGW(TAG, "Tile pool is full, increase tile_pool_size");
+      encoded = FrameTile{TILE_UNKNOWN, 0, 0, TILE_BLOCK_NONE};
+    }
+  }
+  tile = encoded;
+  return true;
+}
+
+void it8951e::load_tile_(uint32_t index, uint16_t length) {
+  //Decodes a tile into tile_raw_
+  const FrameTile &tile = this->frame_tiles_[index];
+  uint8_t *raw = this->tile_raw_.data();
+  switch (tile.kind) {
+    case TILE_UNIFORM:
+      memset(raw, tile.value, length);
+      break;
+    case TILE_RLE:
+      this->tile_pool_.read(tile.block, this->tile_packed_.data(), tile.length);
+      rle_decode(this->tile_packed_.data(), tile.length, raw);
+      break;
+    case TILE_RAW:
+      this->tile_pool_.read(tile.block, raw, tile.length);
+      break;
+    default:
+      memset(raw, this->replicate_value_(this->get_pixel_value_(display::COLOR_OFF)), length);
+      break;
+  }
+}
+
+void it8951e::decode_band_(int y, uint16_t rows) {
+  for (uint16_t ty = y / TILE_SIZE; ty * TILE_SIZE < y + rows; ty++) {
+    for (uint16_t tx = 0; tx < this->tiles_x_; tx++) {
+      uint32_t x0, row_bytes;
+      uint16_t y0, tile_rows;
+      this->get_tile_span_(tx, ty, x0, row_bytes, y0, tile_rows);
+      this->load_tile_(ty * this->tiles_x_ + tx, tile_rows * row_bytes);
+      this->scatter_tile_(tx, ty);
+    }
+  }
+}
+
+bool it8951e::diff_tile_(uint32_t index, uint16_t tx, uint16_t ty) {
+  //Whether a tile of the band differs from what was last sent. The hash is checked before the tile
+  //is encoded, without the frame diff the tile pool compares encodings.
+  if (!this->tile_hashes_.empty()) {
+    const uint32_t hash = this->hash_tile_(this->buffer_, tx, ty);
+    if (hash == this->tile_hashes_[index])
+      return false;
+    this->tile_hashes_[index] = hash;
+  }
+  if (this->frame_tiles_.empty())
+    return true;
+  //A forgotten tile is sent again even if its encoding is the same
+  return this->store_tile_(index, this->gather_tile_(tx, ty)) || !this->tile_hashes_.empty();
+}
+
+bool it8951e::store_band_(int y, uint16_t rows, bool drawn) {
+  //Diffs the band against what was sent and uploads runs of changed tiles right away.
+  //Returns whether all uploaded pixels are black or white.
+  bool binary = true;
+  for (uint16_t ty = y / TILE_SIZE; ty * TILE_SIZE < y + rows; ty++) {
+    int run = -1;
+    for (uint16_t tx = 0; tx <= this->tiles_x_; tx++) {
+      bool changed = false;
+      if (tx < this->tiles_x_) {
+        const uint32_t index = ty * this->tiles_x_ + tx;
+        //A band nothing was drawn on still holds what was decoded, forget_tiles_() may have marked it already
+        changed = this->changed_tiles_[index];
+        if (drawn || changed || this->frame_tiles_[index].kind == TILE_UNKNOWN)
+          changed = this->diff_tile_(index, tx, ty) || changed;
+        this->changed_tiles_[index] = changed;
+      }
+      if (changed && run < 0) {
+        run = tx;
+      } else if (!changed && run >= 0) {
+        const DirtyArea area = {(int16_t) (run * TILE_SIZE), (int16_t) (ty * TILE_SIZE),
+                                (int16_t) (std::min<int>(tx * TILE_SIZE, this->width_) - 1),
+                                (int16_t) (std::min<int>((ty + 1) * TILE_SIZE, this->height_) - 1)};
+        this->wait_for_area_(this->to_panel_area_(this->to_load_area_(area)));
+        this->upload_frame_(this->buffer_, area);
+        binary = binary && this->is_binary_area_(this->buffer_, area);
+        run = -1;
+      }
+    }
+  }
+  return binary;
+}
+
+void it8951e::mark_changed_tiles_() {
+  //Dirty areas from runs of changed tiles, mark_dirty_() merges neighbouring rows
+  this->dirty_count_ = 0;
+  for (uint16_t ty = 0; ty < this->tiles_y_; ty++) {
+    int run = -1;
+    for (uint16_t tx = 0; tx <= this->tiles_x_; tx++) {
+      const bool changed = tx < this->tiles_x_ && this->changed_tiles_[ty * this->tiles_x_ + tx];
+      if (changed && run < 0) {
+        run = tx;
+      } else if (!changed && run >= 0) {
+        this->mark_dirty_(run * TILE_SIZE, ty * TILE_SIZE, std::min<int>(tx * TILE_SIZE, this->width_) - 1,
+                          std::min<int>((ty + 1) * TILE_SIZE, this->height_) - 1);
+        run = -1;
+      }
+    }
+  }
+  std::fill(this->changed_tiles_.begin(), this->changed_tiles_.end(), false);
+}
+
+void it8951e::loop() {
+  //The pipeline task waits for the LUT engines itself and owns the bus while it runs,
+  //once it is idle only refreshes issued from here (the ghosting cleanup) are left to poll
+  if (!this->double_buffer_ || !this->pipeline_busy_) {
+    this->poll_display_ready_();
+#ifdef USE_IT8951E_INK
+    this->flush_ink_();
+#endif
+    this->flush_commands_();
+  }
+
+  //Before a swap can hand frame_timings_ to the pipeline task again
+  if (this->timings_ready_.exchange(false))
+    this->publish_timings_();
+  if (this->lut_ready_.exchange(false))
+    this->publish_lut_time_();
+
+  if (this->update_requested_ && (int32_t) (millis() - this->update_due_) >= 0) {
+    this->update_requested_ = false;
+    this->render_update_();
+  }
+
+  //Ghosting cleanup only runs while there is nothing else to do
+  if (this->cleanup_pending_ && !this->frame_pending_ && !this->update_requested_ && !this->lut_busy_ &&
+      !this->pipeline_busy_ && millis() - this->last_refresh_ms_ >= this->cleanup_delay_) {
+    this->cleanup_pending_ = false;
+    if (this->cleanup_ghosting_())
+      return;
+  }
+
+  if (!this->frame_pending_ || (int32_t) (millis() - this->schedule_retry_) < 0)
+    return;
+  if (this->double_buffer_) {
+    this->swap_buffers_();
+  } else {
+    this->display();
+  }
+}
+void it8951e::fill(Color color) {
+  //Clipped like DisplayBuffer::fill(), banded rendering clips to the strip being drawn
+  if (this->is_clipping() && this->rotation_ == display::DISPLAY_ROTATION_0_DEGREES) {
+    this->filled_rectangle(0, 0, this->width_, this->height_, color);
+    return;
+  }
+  memset(this->buffer_, this->replicate_value_(this->get_pixel_value_(color)), this->get_buffer_length_());
+  //Strips drawn before this one keep their dirty areas
+  if (this->band_height_ == 0)
+    this->dirty_count_ = 0;
+  this->mark_dirty_(0, this->frame_y0_, this->width_ - 1,
+                    std::min<int>(this->frame_y0_ + this->frame_rows_, this->height_) - 1);
+}
+
+uint8_t it8951e::replicate_value_(uint8_t value) {
+  //Replicate the pixel value across a whole byte
+  switch (this->bits_per_pixel_) {
+    case 1:
+      return value * 0xFF;
+    case 2:
+      return value * 0x55;
+    case 4:
+      return value * 0x11;
+    default:
+      return value;
+  }
+}
+
+//-----------------------------------------------------------
+// Gray conversion
+//  Colors are turned into an 8 bit ink intensity (COLOR_ON is full
+//  ink, i.e. black), mapped through LUTs built once per bit depth.
+//  Dithering is ordered Bayer for single pixels and optionally
+//  Floyd-Steinberg error diffusion for whole image rows.
+//-----------------------------------------------------------
+static const uint8_t BAYER_4X4[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+
+void it8951e::build_gray_luts_() {
+  //The controller resolves 16 gray levels, 8bpp just repeats the nibble
+  const uint8_t levels = 1 << std::min<uint8_t>(this->bits_per_pixel_, 4);
+  for (int i = 0; i < 256; i++) {
+    this->level_lut_[i] = (i * (levels - 1) + 127) / 255;
+    this->dither_lut_[i] = i * (levels - 1) * 16 / 255;
+  }
+  for (int level = 0; level < 16; level++) {
+    //Ink level to pixel value, the IT8951 uses 0x0 for black and 0xF for white
+    const uint8_t gray = level < levels ? levels - 1 - level : 0;
+    this->level_value_[level] = this->bits_per_pixel_ == 8 ? gray * 0x11 : gray;
+  }
+  this->max_level_ = levels - 1;
+}
+
+uint8_t it8951e::get_intensity_(Color color) {
+  //COLOR_ON is full ink and COLOR_OFF paper, anything else is RGB and dark colors take more ink.
+  //ESPHome images give opaque pixels as Color(r, g, b, 0xFF), so their white is bit for bit COLOR_ON and
+  //is drawn black, as it is on every other monochrome ESPHome display. Their other colors go by luma.
+  if (color.raw_32 == display::COLOR_ON.raw_32)
+    return 255;
+  if (color.raw_32 == display::COLOR_OFF.raw_32)
+    return 0;
+  return 255 - ((color.r * 77 + color.g * 150 + color.b * 29) >> 8);
+}
+
+uint8_t it8951e::get_pixel_value_(Color color) { return this->level_value_[this->level_lut_[this->get_intensity_(color)]]; }
+
+uint8_t HOT it8951e::get_dithered_value_(uint8_t intensity, int x, int y) {
+  const uint8_t level = (this->dither_lut_[intensity] + BAYER_4X4[y & 3][x & 3]) >> 4;
+  return this->level_value_[level];
+}
+
+void it8951e::draw_gray_image(int x, int y, int width, int height, const uint8_t *data) {
+  this->draw_image_rows_(x, y, width, height, data, 1);
+}
+
+void it8951e::draw_rgb_image(int x, int y, int width, int height, const uint8_t *data) {
+  this->draw_image_rows_(x, y, width, height, data, 3);
+}
+
+void it8951e::draw_image_rows_(int x, int y, int width, int height, const uint8_t *data, uint8_t bytes_per_pixel) {
+  //Source rows are width pixels of luminance (0 is black) or RGB888
+  const int src_stride = width * bytes_per_pixel;
+  if (this->rotation_ != display::DISPLAY_ROTATION_0_DEGREES || this->buffer_ == nullptr) {
+    for (int j = 0; j < height; j++) {
+      const uint8_t *src = data + j * src_stride;
+      for (int i = 0; i < width; i++, src += bytes_per_pixel) {
+        const uint8_t lum = bytes_per_pixel == 1 ? src[0] : (src[0] * 77 + src[1] * 150 + src[2] * 29) >> 8;
+        //White channel 1 keeps white and black from being taken for COLOR_ON and COLOR_OFF
+        this->draw_pixel_at(x + i, y + j, Color(lum, lum, lum, 1));
+      }
+    }
+    return;
+  }
+
+  const int x0 = x, y0 = y;
+  if (!this->clip_fast_(x, y, width, height))
+    return;
+
+  std::vector<uint8_t> &ink = this->row_scratch_;
+  ink.resize(width);
+  //Floyd-Steinberg keeps the error of this row and the next, in 1/16ths, with a pixel of margin on both sides
+  const bool diffuse = this->dither_ == DITHER_FLOYD_STEINBERG;
+  if (diffuse)
+    this->dither_errors_.assign(2 * (width + 2), 0);
+  int16_t *err = this->dither_errors_.data();
+  int16_t *err_next = err + width + 2;
+
+  for (int j = 0; j < height; j++) {
+    const uint8_t *src = data + (y - y0 + j) * src_stride + (x - x0) * bytes_per_pixel;
+    if (bytes_per_pixel == 1) {
+      for (int i = 0; i < width; i++)
+        ink[i] = 255 - src[i];
+    } else {
+      for (int i = 0; i < width; i++, src += 3)
+        ink[i] = 255 - ((src[0] * 77 + src[1] * 150 + src[2] * 29) >> 8);
+    }
+
+    uint8_t *row = this->buffer_ + (y + j - this->frame_y0_) * this->pitch_;
+    switch (this->dither_) {
+      case DITHER_NONE:
+        for (int i = 0; i < width; i++)
+          this->set_pixel_value_(row, x + i, this->level_value_[this->level_lut_[ink[i]]]);
+        break;
+      case DITHER_BAYER:
+        for (int i = 0; i < width; i++)
+          this->set_pixel_value_(row, x + i, this->get_dithered_value_(ink[i], x + i, y + j));
+        break;
+      case DITHER_FLOYD_STEINBERG:
+        for (int i = 0; i < width; i++) {
+          const int wanted = std::min(std::max(ink[i] + err[i + 1] / 16, 0), 255);
+          const uint8_t level = this->level_lut_[wanted];
+          const int error = wanted - level * 255 / this->max_level_;
+          err[i + 2] += error * 7;
+          err_next[i] += error * 3;
+          err_next[i + 1] += error * 5;
+          err_next[i + 2] += error;
+          this->set_pixel_value_(row, x + i, this->level_value_[level]);
+        }
+        std::swap(err, err_next);
+        std::fill(err_next, err_next + width + 2, 0);
+        break;
+    }
+  }
+  this->mark_dirty_(x, y, x + width - 1, y + height - 1);
+}
+
+template<uint8_t BPP> static inline void set_packed_pixel(uint8_t *row, int x, uint8_t value) {
+  //Leftmost pixel sits in the least significant bits. Loaded big endian the bytes go out in memory order,
+  //which is the order the controller unpacks them in.
+  constexpr uint8_t PIXELS_PER_BYTE = 8 / BPP;
+  constexpr uint8_t MASK = (1 << BPP) - 1;
+  uint8_t &b = row[x / PIXELS_PER_BYTE];
+  const uint8_t shift = (x % PIXELS_PER_BYTE) * BPP;
+  b = (b & ~(MASK << shift)) | (value << shift);
+}
+
+bool it8951e::clip_fast_(int &x, int &y, int &width, int &height) {
+  //Returns false when there is nothing left to draw
+  int x1 = x + width, y1 = y + height;
+  x = std::max(x, 0);
+  y = std::max<int>(y, this->frame_y0_);
+  x1 = std::min<int>(x1, this->width_);
+  y1 = std::min<int>(y1, this->frame_y0_ + this->frame_rows_);
+  if (this->is_clipping()) {
+    display::Rect clip = this->get_clipping();
+    x = std::max<int>(x, clip.x);
+    y = std::max<int>(y, clip.y);
+    x1 = std::min<int>(x1, clip.x + clip.w);
+    y1 = std::min<int>(y1, clip.y + clip.h);
+  }
+  width = x1 - x;
+  height = y1 - y;
+  return width > 0 && height > 0;
+}
+
+void HOT it8951e::fill_span_(uint8_t *row, int x0, int x1, uint8_t value) {
+  //Pixels x0..x1 inclusive: partial bytes at both ends, whole bytes up to 4 byte alignment, then 32 bits per store
+  const uint8_t ppb = 8 / this->bits_per_pixel_;
+  int x = x0;
+  for (; x <= x1 && x % ppb != 0; x++)
+    this->set_pixel_value_(row, x, value);
+
+  const int tail = (x1 + 1) - (x1 + 1) % ppb;
+  if (x < tail) {
+    const uint8_t pattern = this->replicate_value_(value);
+    uint8_t *p = row + x / ppb;
+    uint8_t *end = row + tail / ppb;
+    for (; p < end && ((uintptr_t) p & 3) != 0; p++)
+      *p = pattern;
+    const uint32_t pattern32 = pattern * 0x01010101UL;
+    for (; p + 4 <= end; p += 4)
+      memcpy(p, &pattern32, 4);
+    for (; p < end; p++)
+      *p = pattern;
+    x = tail;
+  }
+
+  for (; x <= x1; x++)
+    this->set_pixel_value_(row, x, value);
+}
+
+void it8951e::horizontal_line(int x, int y, int width, Color color) {
+  this->filled_rectangle(x, y, width, 1, color);
+}
+
+void it8951e::vertical_line(int x, int y, int height, Color color) {
+  if (this->rotation_ != display::DISPLAY_ROTATION_0_DEGREES) {
+    display::DisplayBuffer::vertical_line(x, y, height, color);
+    return;
+  }
+  int width = 1;
+  if (!this->clip_fast_(x, y, width, height))
+    return;
+
+  //Same byte and shift in every row, only the row pointer moves
+  const uint8_t ppb = 8 / this->bits_per_pixel_;
+  const uint8_t shift = (x % ppb) * this->bits_per_pixel_;
+  const uint8_t mask = ((1 << this->bits_per_pixel_) - 1) << shift;
+  const uint8_t bits = this->get_pixel_value_(color) << shift;
+  uint8_t *p = this->buffer_ + (y - this->frame_y0_) * this->pitch_ + x / ppb;
+  for (int i = 0; i < height; i++, p += this->pitch_)
+    *p = (*p & ~mask) | bits;
+  this->mark_dirty_(x, y, x, y + height - 1);
+}
+
+void it8951e::rectangle(int x1, int y1, int width, int height, Color color) {
+  this->horizontal_line(x1, y1, width, color);
+  this->horizontal_line(x1, y1 + height - 1, width, color);
+  this->vertical_line(x1, y1, height, color);
+  this->vertical_line(x1 + width - 1, y1, height, color);
+}
+
+void it8951e::filled_rectangle(int x1, int y1, int width, int height, Color color) {
+  if (this->rotation_ != display::DISPLAY_ROTATION_0_DEGREES) {
+    display::DisplayBuffer::filled_rectangle(x1, y1, width, height, color);
+    return;
+  }
+  if (!this->clip_fast_(x1, y1, width, height))
+    return;
+
+  const uint8_t value = this->get_pixel_value_(color);
+  uint8_t *row = this->buffer_ + (y1 - this->frame_y0_) * this->pitch_;
+  for (int i = 0; i < height; i++, row += this->pitch_)
+    this->fill_span_(row, x1, x1 + width - 1, value);
+  this->mark_dirty_(x1, y1, x1 + width - 1, y1 + height - 1);
+}
+
+void HOT it8951e::draw_absolute_pixel_internal(int x, int y, Color color) {
+  if (this->capture_ != nullptr) {
+    this->capture_pixel_(x, y, color);
+    return;
+  }
+  if (x >= this->width_ || y >= this->frame_y0_ + this->frame_rows_ || x < 0 || y < this->frame_y0_)
+    return;
+
+  const uint8_t value = this->dither_ == DITHER_NONE ? this->get_pixel_value_(color)
+                                                     : this->get_dithered_value_(this->get_intensity_(color), x, y);
+  this->set_pixel_value_(this->buffer_ + (y - this->frame_y0_) * this->pitch_, x, value);
+  this->mark_dirty_(x, y, x, y);
+}
+
+void HOT it8951e::set_pixel_value_(uint8_t *row, int x, uint8_t value) {
+  switch (this->bits_per_pixel_) {
+    case 1:
+      set_packed_pixel<1>(row, x, value);
+      break;
+    case 2:
+      set_packed_pixel<2>(row, x, value);
+      break;
+    case 4:
+      set_packed_pixel<4>(row, x, value);
+      break;
+    default:
+      row[x] = value;
+      break;
+  }
+}
+
+//-----------------------------------------------------------
+// Glyph cache
+//  Glyphs are rasterized once by the font into a packed cell of
+//  advance x font height, foreground on an opaque background, and
+//  kept in LRU order until glyph_cache_size_ bytes are used. Drawing
+//  a cached glyph copies packed rows instead of running the font.
+//-----------------------------------------------------------
+static size_t glyph_bytes(const CachedGlyph &glyph) { return sizeof(CachedGlyph) + glyph.data.size(); }
+
+void it8951e::capture_pixel_(int x, int y, Color color) {
+  //Font coordinates are relative to the print origin, the cell may start left of it
+  CachedGlyph &glyph = *this->capture_;
+  const int col = x - glyph.x_offset;
+  if (col < 0 || col >= glyph.width || y < 0 || y >= glyph.height)
+    return;
+  this->set_pixel_value_(glyph.data.data() + y * glyph.row_bytes, col, this->get_pixel_value_(color));
+}
+
+void it8951e::rasterize_glyph_(CachedGlyph &glyph, display::BaseFont *font, Color color, const char *utf8) {
+  int advance, x_offset, baseline, height;
+  font->measure(utf8, &advance, &x_offset, &baseline, &height);
+  glyph.x_offset = std::min(x_offset, 0);
+  glyph.advance = std::max(advance, 0);
+  glyph.width = std::max(advance - glyph.x_offset, 0);
+  glyph.height = std::max(height, 0);
+  glyph.row_bytes = (glyph.width * this->bits_per_pixel_ + 7) / 8;
+  glyph.data.assign(glyph.row_bytes * glyph.height, this->replicate_value_(glyph.key.bg));
+
+  //Nothing may clip the capture, the caller's clipping applies when the glyph is drawn
+  std::vector<display::Rect> clipping;
+  std::swap(clipping, this->clipping_rectangle_);
+  this->capture_ = &glyph;
+  font->print(0, 0, this, color, utf8);
+  this->capture_ = nullptr;
+  std::swap(clipping, this->clipping_rectangle_);
+}
+
+const CachedGlyph &it8951e::get_glyph_(display::BaseFont *font, Color color, Color background, uint32_t codepoint,
+                                       const char *utf8) {
+  const GlyphKey key = {font, codepoint, this->get_pixel_value_(color), this->get_pixel_value_(background)};
+  auto it = this->glyph_index_.find(key);
+  if (it != this->glyph_index_.end()) {
+    //Hit, move to the front of the LRU list
+    this->glyphs_.splice(this->glyphs_.begin(), this->glyphs_, it->second);
+    return *it->second;
+  }
+
+  CachedGlyph glyph;
+  glyph.key = key;
+  this->rasterize_glyph_(glyph, font, color, utf8);
+  const size_t bytes = glyph_bytes(glyph);
+  if (bytes > this->glyph_cache_size_) {
+    //Too big to ever be cached, keep it around until the next miss
+    this->glyph_scratch_ = std::move(glyph);
+    return this->glyph_scratch_;
+  }
+  while (this->glyph_cache_used_ + bytes > this->glyph_cache_size_) {
+    const CachedGlyph &oldest = this->glyphs_.back();
+    this->glyph_cache_used_ -= glyph_bytes(oldest);
+    this->glyph_index_.erase(oldest.key);
+    this->glyphs_.pop_back();
+  }
+  this->glyph_cache_used_ += bytes;
+  this->glyphs_.push_front(std::move(glyph));
+  this->glyph_index_[key] = this->glyphs_.begin();
+  return this->glyphs_.front();
+}
+
+void HOT it8951e::blit_packed_row_(uint8_t *row, int x, const uint8_t *src, int width) {
+  //Source rows start at pixel 0 of their first byte. An unaligned x (odd x at 4bpp)
+  //shifts every byte by the pixel offset and carries the spill into the next byte.
+  const uint8_t ppb = 8 / this->bits_per_pixel_;
+  const uint8_t shift = (x % ppb) * this->bits_per_pixel_;
+  const int total_bits = shift + width * this->bits_per_pixel_;
+  const int src_bytes = (width * this->bits_per_pixel_ + 7) / 8;
+  const int dst_bytes = (total_bits + 7) / 8;
+  uint8_t *dst = row + x / ppb;
+  uint8_t carry = 0;
+  for (int i = 0; i < dst_bytes; i++) {
+    const uint8_t in = i < src_bytes ? src[i] : 0;
+    const uint8_t out = (uint8_t) (in << shift) | carry;
+    carry = shift != 0 ? in >> (8 - shift) : 0;
+    uint8_t mask = 0xFF;
+    if (i == 0)
+      mask &= 0xFF << shift;
+    if (i == dst_bytes - 1 && total_bits % 8 != 0)
+      mask &= 0xFF >> (8 - total_bits % 8);
+    dst[i] = (dst[i] & ~mask) | (out & mask);
+  }
+}
+
+void it8951e::blit_glyph_(const CachedGlyph &glyph, int x, int y) {
+  const int x0 = x + glyph.x_offset;
+  int cx = x0, cy = y, cw = glyph.width, ch = glyph.height;
+  if (!this->clip_fast_(cx, cy, cw, ch))
+    return;
+
+  if (cw == glyph.width && ch == glyph.height) {
+    //Fully visible, whole packed rows
+    uint8_t *row = this->buffer_ + (y - this->frame_y0_) * this->pitch_;
+    const uint8_t *src = glyph.data.data();
+    for (int i = 0; i < ch; i++, row += this->pitch_, src += glyph.row_bytes)
+      this->blit_packed_row_(row, x0, src, glyph.width);
+  } else {
+    //Partly clipped, copy pixel by pixel
+    const uint8_t ppb = 8 / this->bits_per_pixel_;
+    const uint8_t mask = (1 << this->bits_per_pixel_) - 1;
+    for (int py = cy; py < cy + ch; py++) {
+      uint8_t *row = this->buffer_ + (py - this->frame_y0_) * this->pitch_;
+      const uint8_t *src = glyph.data.data() + (py - y) * glyph.row_bytes;
+      for (int px = cx; px < cx + cw; px++) {
+        const int col = px - x0;
+        this->set_pixel_value_(row, px, (src[col / ppb] >> ((col % ppb) * this->bits_per_pixel_)) & mask);
+      }
+    }
+  }
+  this->mark_dirty_(cx, cy, cx + cw - 1, cy + ch - 1);
+}
+
+void it8951e::print_cached(int x, int y, display::BaseFont *font, Color color, Color background,
+                           display::TextAlign align, const char *text) {
+  int x1, y1, width, height;
+  this->get_text_bounds(x, y, text, font, align, &x1, &y1, &width, &height);
+  if (this->glyph_cache_size_ == 0 || this->rotation_ != display::DISPLAY_ROTATION_0_DEGREES ||
+      this->buffer_ == nullptr) {
+    this->filled_rectangle(x1, y1, width, height, background);
+    this->print(x1, y1, font, color, display::TextAlign::TOP_LEFT, text);
+    return;
+  }
+
+  //One glyph per UTF-8 sequence, each advances the pen by its own width
+  int pen = x1;
+  const char *p = text;
+  while (*p != '\0') {
+    const uint8_t lead = *p;
+    const int len = lead < 0x80 ? 1 : (lead >> 5) == 0x06 ? 2 : (lead >> 4) == 0x0E ? 3 : (lead >> 3) == 0x1E ? 4 : 1;
+    char utf8[5] = {0};
+    uint32_t codepoint = len == 1 ? lead : lead & (0x7F >> len);
+    int i = 0;
+    for (; i < len && p[i] != '\0'; i++) {
+      utf8[i] = p[i];
+      if (i > 0)
+        codepoint = (codepoint << 6) | (p[i] & 0x3F);
+    }
+    p += i;
+
+    const CachedGlyph &glyph = this->get_glyph_(font, color, background, codepoint, utf8);
+    this->blit_glyph_(glyph, pen, y1);
+    pen += glyph.advance;
+  }
+}
+
+static DirtyArea asset_area(const PlacedAsset &placed) {
+  return {(int16_t) placed.x, (int16_t) placed.y, (int16_t) (placed.x + placed.width - 1),
+          (int16_t) (placed.y + placed.asset->get_height() - 1)};
+}
+
+static bool areas_overlap(const DirtyArea &a, const DirtyArea &b) {
+  return !(b.x0 > a.x1 || b.x1 < a.x0 || b.y0 > a.y1 || b.y1 < a.y0);
+}
+
+// Pixels an area gains when it is grown to also cover (x0,y0)-(x1,y1)
+static int32_t dirty_growth(const DirtyArea &area, int x0, int y0, int x1, int y1) {
+  const int32_t w = std::max<int>(area.x1, x1) - std::min<int>(area.x0, x0) + 1;
+  const int32_t h = std::max<int>(area.y1, y1) - std::min<int>(area.y0, y0) + 1;
+  return w * h - (area.x1 - area.x0 + 1) * (area.y1 - area.y0 + 1);
+}
+
+void it8951e::mark_dirty_(int x0, int y0, int x1, int y1) {
+  // Fast path: consecutive pixels of a primitive usually land in the same area
+  if (this->dirty_count_ > 0) {
+    const DirtyArea &last = this->dirty_areas_[this->dirty_last_];
+    if (x0 >= last.x0 && x1 <= last.x1 && y0 >= last.y0 && y1 <= last.y1)
+      return;
+  }
+
+  int best = -1;
+  int32_t best_growth = INT32_MAX;
+  for (uint8_t i = 0; i < this->dirty_count_; i++) {
+    const DirtyArea &area = this->dirty_areas_[i];
+    const int32_t growth = dirty_growth(area, x0, y0, x1, y1);
+    const bool near = x0 <= area.x1 + DIRTY_MERGE_DISTANCE && x1 >= area.x0 - DIRTY_MERGE_DISTANCE &&
+                      y0 <= area.y1 + DIRTY_MERGE_DISTANCE && y1 >= area.y0 - DIRTY_MERGE_DISTANCE;
+    if (near && growth < best_growth) {
+      best = i;
+      best_growth = growth;
+    }
+  }
+
+  if (best < 0 && this->dirty_count_ < MAX_DIRTY_AREAS) {
+    this->dirty_areas_[this->dirty_count_] = DirtyArea{(int16_t) x0, (int16_t) y0, (int16_t) x1, (int16_t) y1};
+    this->dirty_last_ = this->dirty_count_++;
+    return;
+  }
+
+  if (best < 0) {
+    // Out of slots, grow whichever area gets the least bigger
+    for (uint8_t i = 0; i < this->dirty_count_; i++) {
+      const int32_t growth = dirty_growth(this->dirty_areas_[i], x0, y0, x1, y1);
+      if (growth < best_growth) {
+        best = i;
+        best_growth = growth;
+      }
+    }
+  }
+
+  DirtyArea &area = this->dirty_areas_[best];
+  area.x0 = std::min<int>(area.x0, x0);
+  area.y0 = std::min<int>(area.y0, y0);
+  area.x1 = std::max<int>(area.x1, x1);
+  area.y1 = std::max<int>(area.y1, y1);
+  this->dirty_last_ = best;
+}
+
+void it8951e::coalesce_dirty_() {
+  // Growing areas can make them overlap, merge until all are disjoint
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    for (uint8_t i = 0; i < this->dirty_count_ && !merged; i++) {
+      for (uint8_t j = i + 1; j < this->dirty_count_; j++) {
+        DirtyArea &a = this->dirty_areas_[i];
+        const DirtyArea &b = this->dirty_areas_[j];
+        if (b.x0 > a.x1 || b.x1 < a.x0 || b.y0 > a.y1 || b.y1 < a.y0)
+          continue;
+        a.x0 = std::min(a.x0, b.x0);
+        a.y0 = std::min(a.y0, b.y0);
+        a.x1 = std::max(a.x1, b.x1);
+        a.y1 = std::max(a.y1, b.y1);
+        this->dirty_areas_[j] = this->dirty_areas_[--this->dirty_count_];
+        merged = true;
+        break;
+      }
+    }
+  }
+  this->dirty_last_ = 0;
+}
+
+bool it8951e::overlaps_dirty_(const DirtyArea &area) {
+  for (uint8_t i = 0; i < this->dirty_count_; i++) {
+    if (areas_overlap(this->dirty_areas_[i], area))
+      return true;
+  }
+  return false;
+}
+
+uint32_t it8951e::hash_tile_(const uint8_t *frame, uint16_t tx, uint16_t ty) {
+  //FNV-1a over 32 bit words, a tile row is TILE_SIZE * bpp / 8 bytes
+  const uint32_t x0 = tx * TILE_SIZE * this->bits_per_pixel_ / 8;
+  const uint32_t x1 = std::min<uint32_t>(x0 + TILE_SIZE * this->bits_per_pixel_ / 8, this->pitch_);
+  const uint16_t y1 = std::min<uint16_t>((ty + 1) * TILE_SIZE, this->height_);
+  uint32_t hash = 2166136261UL;
+  for (uint16_t y = ty * TILE_SIZE; y < y1; y++) {
+    const uint8_t *row = frame + (y - this->frame_y0_) * this->pitch_;
+    uint32_t x = x0;
+    for (; x + 4 <= x1; x += 4) {
+      uint32_t w;
+      memcpy(&w, row + x, 4);
+      hash = (hash ^ w) * 16777619UL;
+    }
+    for (; x < x1; x++)
+      hash = (hash ^ row[x]) * 16777619UL;
+  }
+  //Keep 0 free for "unknown"
+  return hash != 0 ? hash : 1;
+}
+
+void it8951e::diff_dirty_(const uint8_t *frame) {
+  //Drawing may have rewritten pixels with the values the controller already has.
+  //Only tiles inside dirty areas can differ, hash those against what was last sent.
+  for (uint8_t i = 0; i < this->dirty_count_; i++) {
+    const DirtyArea &area = this->dirty_areas_[i];
+    for (uint16_t ty = area.y0 / TILE_SIZE; ty <= area.y1 / TILE_SIZE; ty++) {
+      for (uint16_t tx = area.x0 / TILE_SIZE; tx <= area.x1 / TILE_SIZE; tx++) {
+        const uint32_t index = ty * this->tiles_x_ + tx;
+        const uint32_t hash = this->hash_tile_(frame, tx, ty);
+        if (hash != this->tile_hashes_[index]) {
+          this->tile_hashes_[index] = hash;
+          this->changed_tiles_[index] = true;
+        }
+      }
+    }
+  }
+
+  //Rebuild the dirty list from horizontal runs of changed tiles, clipped to the old areas.
+  //mark_dirty_() merges the runs of neighbouring tile rows back into rectangles.
+  DirtyArea areas[MAX_DIRTY_AREAS];
+  const uint8_t count = this->dirty_count_;
+  memcpy(areas, this->dirty_areas_, sizeof(DirtyArea) * count);
+  this->dirty_count_ = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    const DirtyArea &area = areas[i];
+    const uint16_t tx0 = area.x0 / TILE_SIZE, tx1 = area.x1 / TILE_SIZE;
+    for (uint16_t ty = area.y0 / TILE_SIZE; ty <= area.y1 / TILE_SIZE; ty++) {
+      int run = -1;
+      for (uint16_t tx = tx0; tx <= tx1 + 1; tx++) {
+        const bool changed = tx <= tx1 && this->changed_tiles_[ty * this->tiles_x_ + tx];
+        if (changed && run < 0) {
+          run = tx;
+        } else if (!changed && run >= 0) {
+          this->mark_dirty_(std::max<int>(area.x0, run * TILE_SIZE), std::max<int>(area.y0, ty * TILE_SIZE),
+                            std::min<int>(area.x1, tx * TILE_SIZE - 1), std::min<int>(area.y1, (ty + 1) * TILE_SIZE - 1));
+          run = -1;
+        }
+      }
+    }
+  }
+  this->coalesce_dirty_();
+  std::fill(this->changed_tiles_.begin(), this->changed_tiles_.end(), false);
+}
+
+void it8951e::display(){
+  //Banded mode has no frame to send, update() uploads strip by strip
+  if (this->band_height_ != 0)
+    return;
+  if (this->buffer_ == nullptr)
+    return;
+  this->settle_blits_();
+  if (this->dirty_count_ == 0) {
+    this->flush_direct_updates_();
+    return;
+  }
+
+  if (this->double_buffer_) {
+    //The pipeline task picks the frame up once it is done with the previous one
+    this->frame_pending_ = true;
+    this->swap_buffers_();
+    return;
+  }
+
+  this->frame_pending_ = false;
+
+  const uint32_t start = micros();
+  this->coalesce_dirty_();
+  if (this->frame_diff_) {
+    this->diff_dirty_(this->buffer_);
+    if (this->dirty_count_ == 0) {
+      this->flush_direct_updates_();
+      return;
+    }
+  }
+  //Whatever can't go out yet stays dirty and is retried from loop()
+  DirtyArea areas[MAX_SCHEDULED_AREAS];
+  uint8_t priority;
+  const uint8_t count = this->schedule_areas_(areas, priority);
+  this->render_timings_.pack_us = micros() - start;
+  if (count == 0)
+    return;
+  this->frame_timings_ = this->render_timings_;
+  this->display_frame_(this->buffer_, areas, count, priority);
+}
+
+//-----------------------------------------------------------
+// Update scheduling
+//  Dirty areas are split along the tile grid into the configured
+//  regions plus the rest of the screen (region 0). A region refreshed
+//  less than its min_interval ago keeps its areas dirty until it is
+//  due, as do areas an engine is still refreshing, so neither holds
+//  back the others. Priority regions are uploaded and refreshed one by
+//  one before anything else is uploaded. Double buffered and banded
+//  frames have no regions, min_refresh_interval holds back the whole
+//  frame there: swapping it, or drawing it in banded mode.
+//-----------------------------------------------------------
+void it8951e::add_region(int16_t x, int16_t y, int16_t width, int16_t height, uint32_t min_interval, bool priority) {
+  if (this->regions_.size() == MAX_UPDATE_REGIONS) {
+    ESP_LOGW(TAG, "At most %u update regions are supported", MAX_UPDATE_REGIONS);
+    return;
+  }
+  UpdateRegion region{};
+  region.area = DirtyArea{x, y, (int16_t) (x + width - 1), (int16_t) (y + height - 1)};
+  region.min_interval = min_interval;
+  region.priority = priority;
+  this->regions_.push_back(region);
+}
+
+uint32_t it8951e::region_wait_(const UpdateRegion &region, uint32_t now) {
+  //Time left until the region may be refreshed again, 0 when it is due
+  const uint32_t since = now - region.last_refresh;
+  return region.refreshed && since < region.min_interval ? region.min_interval - since : 0;
+}
+
+void it8951e::mark_region_tiles_(const DirtyArea &area, uint8_t id) {
+  //Runs of the area's tiles that belong to region id, clipped to the area
+  if (this->tile_regions_.empty()) {
+    this->mark_dirty_(area.x0, area.y0, area.x1, area.y1);
+    return;
+  }
+  const uint16_t tx0 = area.x0 / TILE_SIZE, tx1 = area.x1 / TILE_SIZE;
+  for (uint16_t ty = area.y0 / TILE_SIZE; ty <= area.y1 / TILE_SIZE; ty++) {
+    int run = -1;
+    for (uint16_t tx = tx0; tx <= tx1 + 1; tx++) {
+      const bool inside = tx <= tx1 && this->tile_regions_[ty * this->tiles_x_ + tx] == id;
+      if (inside && run < 0) {
+        run = tx;
+      } else if (!inside && run >= 0) {
+        this->mark_dirty_(std::max<int>(area.x0, run * TILE_SIZE), std::max<int>(area.y0, ty * TILE_SIZE),
+                          std::min<int>(area.x1, tx * TILE_SIZE - 1), std::min<int>(area.y1, (ty + 1) * TILE_SIZE - 1));
+        run = -1;
+      }
+    }
+  }
+}
+
+void it8951e::forget_tiles_(const DirtyArea &area) {
+  //The frame diff compares against what was sent, these tiles weren't.
+  //Without it the tile pool's tiles are just sent again.
+  if (this->tile_hashes_.empty() && this->frame_tiles_.empty())
+    return;
+  for (uint16_t ty = area.y0 / TILE_SIZE; ty <= area.y1 / TILE_SIZE; ty++) {
+    for (uint16_t tx = area.x0 / TILE_SIZE; tx <= area.x1 / TILE_SIZE; tx++) {
+      if (this->tile_hashes_.empty())
+        this->changed_tiles_[ty * this->tiles_x_ + tx] = true;
+      else
+        this->tile_hashes_[ty * this->tiles_x_ + tx] = 0;
+    }
+  }
+}
+
+uint8_t it8951e::schedule_areas_(DirtyArea *out, uint8_t &priority) {
+  const uint32_t now = millis();
+  DirtyArea dirty[MAX_DIRTY_AREAS];
+  const uint8_t dirty_count = this->dirty_count_;
+  memcpy(dirty, this->dirty_areas_, sizeof(DirtyArea) * dirty_count);
+  DirtyArea deferred[MAX_SCHEDULED_AREAS];
+  uint8_t count = 0, deferred_count = 0;
+  uint32_t retry = UINT32_MAX;
+
+  for (uint8_t pass = 0; pass < 2; pass++) {
+    if (pass == 1)
+      priority = count;
+    for (uint8_t id = 0; id <= this->regions_.size(); id++) {
+      UpdateRegion &region = this->get_region_(id);
+      if (region.priority != (pass == 0))
+        continue;
+      //The region's share of every dirty area, merged the same way drawing marks them
+      this->dirty_count_ = 0;
+      for (uint8_t i = 0; i < dirty_count; i++)
+        this->mark_region_tiles_(dirty[i], id);
+
+      const uint32_t wait = this->region_wait_(region, now);
+      const bool limited = wait != 0;
+      if (limited)
+        retry = std::min(retry, wait);
+      bool sent = false;
+      for (uint8_t i = 0; i < this->dirty_count_; i++) {
+        const DirtyArea &area = this->dirty_areas_[i];
+        if (!limited && !this->overlaps_inflight_(this->to_panel_area_(this->to_load_area_(area)))) {
+          out[count++] = area;
+          sent = true;
+          continue;
+        }
+        //Busy areas are retried from loop() once their engines are done, instead of blocking here
+        if (!limited)
+          retry = 0;
+        deferred[deferred_count++] = area;
+      }
+      if (sent) {
+        region.refreshed = true;
+        region.last_refresh = now;
+      }
+    }
+  }
+
+  this->dirty_count_ = 0;
+  for (uint8_t i = 0; i < deferred_count; i++) {
+    const DirtyArea &area = deferred[i];
+    this->mark_dirty_(area.x0, area.y0, area.x1, area.y1);
+    if (this->frame_diff_)
+      this->forget_tiles_(area);
+  }
+  if (deferred_count > 0) {
+    this->frame_pending_ = true;
+    this->schedule_retry_ = now + retry;
+  }
+  return count;
+}
+
+void it8951e::display_frame_(const uint8_t *frame, const DirtyArea *areas, uint8_t count, uint8_t priority) {
+  this->hrdy_wait_us_ = 0;
+  this->hrdy_wait_max_us_ = 0;
+  this->hrdy_waits_ = 0;
+
+  //Don't overwrite image memory an engine is still reading from, other engines may keep running
+  const ProtocolStats before = this->stats_;
+  uint32_t lut_wait_us = 0;
+  uint32_t transfer_us = 0;
+  //Priority areas don't wait for the others to be uploaded, unless a full refresh shows everything at once
+  if (this->full_update_due_())
+    priority = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    const uint32_t start = micros();
+    this->wait_for_area_(this->to_panel_area_(this->to_load_area_(areas[i])));
+    const uint32_t transfer_start = micros();
+    this->upload_frame_(frame, areas[i]);
+    lut_wait_us += transfer_start - start;
+    transfer_us += micros() - transfer_start;
+    if (i < priority)
+      this->refresh_area_(frame, areas[i]);
+  }
+  this->frame_timings_.transfer_us = transfer_us;
+
+  this->refresh_areas_(frame, areas, count, priority);
+
+  //Handed to loop(), which may be another task than this one
+  this->frame_timings_.bytes = this->stats_.bytes_written - before.bytes_written;
+  this->frame_timings_.busy_us = lut_wait_us + this->hrdy_wait_us_;
+  this->timings_ready_ = true;
+}
+
+bool it8951e::full_update_due_() {
+  //Every full_update_every_ updates the whole panel gets a flashing GC16 to clear ghosting
+  return this->force_full_update_ ||
+         (this->full_update_every_ > 0 && this->partial_updates_ >= this->full_update_every_);
+}
+
+void it8951e::refresh_area_(const uint8_t *frame, const DirtyArea &area) {
+  const DirtyArea panel_area = this->to_panel_area_(area);
+  //Without a frame (banded mode) one waveform covers all areas
+  uint16_t mode = frame != nullptr     ? this->select_waveform_(frame, area)
+                  : this->band_binary_ ? IT8951_MODE_DU
+                                       : IT8951_MODE_GC16;
+  if (mode != IT8951_MODE_GC16 && this->over_gray_asset_(area)) {
+    mode = IT8951_MODE_GC16;
+    this->mark_gray_tiles_(area);
+  }
+  this->IT8951DisplayArea(panel_area.x0, panel_area.y0, panel_area.x1 - panel_area.x0 + 1,
+                          panel_area.y1 - panel_area.y0 + 1, mode);
+  this->track_refresh_(panel_area);
+  this->cover_blits_(panel_area);
+  this->count_ghosting_(area, mode == IT8951_MODE_GC16);
+}
+
+void it8951e::refresh_areas_(const uint8_t *frame, const DirtyArea *areas, uint8_t count, uint8_t refreshed) {
+  if (this->full_update_due_()) {
+    this->force_full_update_ = false;
+    const DirtyArea panel = {0, 0, (int16_t) (this->gstI80DevInfo.usPanelW - 1),
+                             (int16_t) (this->gstI80DevInfo.usPanelH - 1)};
+    this->wait_for_area_(panel);
+    this->IT8951DisplayArea(0, 0, this->gstI80DevInfo.usPanelW, this->gstI80DevInfo.usPanelH, IT8951_MODE_GC16);
+    this->track_refresh_(panel);
+    this->cover_blits_(panel);
+    this->partial_updates_ = 0;
+    std::fill(this->gray_tiles_.begin(), this->gray_tiles_.end(), true);
+    std::fill(this->ghost_counts_.begin(), this->ghost_counts_.end(), 0);
+    this->cleanup_pending_ = false;
+  } else {
+    //The first refreshed areas already went out as they were uploaded
+    for (uint8_t i = refreshed; i < count; i++)
+      this->refresh_area_(frame, areas[i]);
+    this->partial_updates_++;
+  }
+  this->last_refresh_ms_ = millis();
+  //Cached images go last so they end up on top of the frame
+  this->flush_direct_updates_();
+  this->flush_commands_();
+
+  ESP_LOGD(TAG, "Sent %u area(s), %u HRDY waits took %u us (longest %u us)", count, this->hrdy_waits_,
+           this->hrdy_wait_us_, this->hrdy_wait_max_us_);
+}
+
+//-----------------------------------------------------------
+// Ghosting cleanup
+//  DU and A2 leave residue behind that only GC16 clears. Instead of
+//  flashing the whole panel every full_update_every updates, the tiles
+//  that got cleanup_threshold_ fast refreshes since their last GC16
+//  get a GC16 of their own while the display is idle. Image memory
+//  already holds what they show, nothing has to be uploaded.
+//-----------------------------------------------------------
+void it8951e::count_ghosting_(const DirtyArea &area, bool cleared) {
+  if (this->ghost_counts_.empty())
+    return;
+  for (uint16_t ty = area.y0 / TILE_SIZE; ty <= area.y1 / TILE_SIZE; ty++) {
+    for (uint16_t tx = area.x0 / TILE_SIZE; tx <= area.x1 / TILE_SIZE; tx++) {
+      uint8_t &count = this->ghost_counts_[ty * this->tiles_x_ + tx];
+      if (cleared) {
+        count = 0;
+        continue;
+      }
+      if (count < UINT8_MAX)
+        count++;
+      if (count >= this->cleanup_threshold_)
+        this->cleanup_pending_ = true;
+    }
+  }
+}
+
+bool it8951e::cleanup_ghosting_() {
+  //Runs of tiles past the threshold, merged like drawing marks areas. The dirty list is borrowed for that.
+  DirtyArea dirty[MAX_DIRTY_AREAS];
+  const uint8_t dirty_count = this->dirty_count_;
+  const uint8_t dirty_last = this->dirty_last_;
+  memcpy(dirty, this->dirty_areas_, sizeof(DirtyArea) * dirty_count);
+  this->dirty_count_ = 0;
+  for (uint16_t ty = 0; ty < this->tiles_y_; ty++) {
+    int run = -1;
+    for (uint16_t tx = 0; tx <= this->tiles_x_; tx++) {
+      const bool ghosted = tx < this->tiles_x_ && this->ghost_counts_[ty * this->tiles_x_ + tx] >= this->cleanup_threshold_;
+      if (ghosted && run < 0) {
+        run = tx;
+      } else if (!ghosted && run >= 0) {
+        this->mark_dirty_(run * TILE_SIZE, ty * TILE_SIZE, std::min<int>(tx * TILE_SIZE, this->width_) - 1,
+                          std::min<int>((ty + 1) * TILE_SIZE, this->height_) - 1);
+        run = -1;
+      }
+    }
+  }
+  DirtyArea areas[MAX_DIRTY_AREAS];
+  const uint8_t count = this->dirty_count_;
+  memcpy(areas, this->dirty_areas_, sizeof(DirtyArea) * count);
+  memcpy(this->dirty_areas_, dirty, sizeof(DirtyArea) * dirty_count);
+  this->dirty_count_ = dirty_count;
+  this->dirty_last_ = dirty_last;
+
+  for (uint8_t i = 0; i < count; i++) {
+    const DirtyArea area = this->to_panel_area_(areas[i]);
+    this->IT8951DisplayArea(area.x0, area.y0, area.x1 - area.x0 + 1, area.y1 - area.y0 + 1, IT8951_MODE_GC16);
+    this->track_refresh_(area);
+    this->cover_blits_(area);
+    this->count_ghosting_(areas[i], true);
+  }
+  this->flush_direct_updates_(true);
+  this->flush_commands_();
+  if (count > 0)
+    ESP_LOGD(TAG, "Cleaned up ghosting in %u area(s)", count);
+  return count > 0;
+}
+
+#ifdef USE_IT8951E_INK
+//-----------------------------------------------------------
+// Ink
+//  Touches are drawn into the frame as soon as the touchscreen reports
+//  them, without going through the writer or display(). loop() uploads
+//  their bounds and refreshes them with A2. Strokes drawn while the last
+//  ink refresh is still running are sent together once it is done.
+//  The pixels are not marked dirty; a later update that covers them
+//  sends them again with the regular waveform. Strokes only live in the
+//  frame, so auto clear has to be off (display.py checks it) or every
+//  update erases them.
+//-----------------------------------------------------------
+void it8951e::set_ink_touchscreen(gt911::GT911 *touchscreen) {
+  this->ink_touchscreen_ = touchscreen;
+  touchscreen->add_touch_callback(
+      [this](const gt911::TP_Point *points, uint8_t count) { this->ink_touches_(points, count); });
+}
+
+void it8951e::ink_to_frame_(int &x, int &y) {
+  //The touchscreen reports panel coordinates. Software rotation keeps the frame in panel coordinates,
+  //hardware rotation loads a rotated frame: the inverse of to_panel_area_().
+  const int w = this->gstI80DevInfo.usPanelW, h = this->gstI80DevInfo.usPanelH;
+  const int px = x, py = y;
+  switch (this->hw_rotate_) {
+    case IT8951_ROTATE_90:
+      x = py;
+      y = w - 1 - px;
+      break;
+    case IT8951_ROTATE_180:
+      x = w - 1 - px;
+      y = h - 1 - py;
+      break;
+    case IT8951_ROTATE_270:
+      x = h - 1 - py;
+      y = px;
+      break;
+    default:
+      break;
+  }
+}
+
+void it8951e::ink_touches_(const gt911::TP_Point *points, uint8_t count) {
+  //Strokes go straight into the frame, it has to be whole
+  if (this->buffer_ == nullptr || this->double_buffer_ || this->band_height_ != 0)
+    return;
+
+  bool down[INK_TOUCH_IDS] = {};
+  for (uint8_t i = 0; i < count; i++) {
+    const uint8_t id = points[i].id % INK_TOUCH_IDS;
+    int x = points[i].x, y = points[i].y;
+    this->ink_to_frame_(x, y);
+    if (!this->ink_down_[id]) {
+      this->ink_dot_(x, y);
+    } else {
+      //Bresenham from the last point, a pen dot at every step
+      int x0 = this->ink_last_x_[id], y0 = this->ink_last_y_[id];
+      const int dx = abs(x - x0), sx = x0 < x ? 1 : -1;
+      const int dy = -abs(y - y0), sy = y0 < y ? 1 : -1;
+      int err = dx + dy;
+      while (true) {
+        this->ink_dot_(x0, y0);
+        if (x0 == x && y0 == y)
+          break;
+        const int e2 = 2 * err;
+        if (e2 >= dy) {
+          err += dy;
+          x0 += sx;
+        }
+        if (e2 <= dx) {
+          err += dx;
+          y0 += sy;
+        }
+      }
+    }
+    down[id] = true;
+    this->ink_last_x_[id] = x;
+    this->ink_last_y_[id] = y;
+  }
+  //Ids missing from the report were lifted, their next touch starts a new stroke
+  memcpy(this->ink_down_, down, sizeof(down));
+}
+
+void it8951e::ink_dot_(int x, int y) {
+  int width = this->ink_pen_size_, height = this->ink_pen_size_;
+  x -= width / 2;
+  y -= height / 2;
+  if (!this->clip_fast_(x, y, width, height))
+    return;
+
+  const uint8_t value = this->get_pixel_value_(display::COLOR_ON);
+  uint8_t *row = this->buffer_ + (y - this->frame_y0_) * this->pitch_;
+  for (int i = 0; i < height; i++, row += this->pitch_)
+    this->fill_span_(row, x, x + width - 1, value);
+
+  const DirtyArea dot = {(int16_t) x, (int16_t) y, (int16_t) (x + width - 1), (int16_t) (y + height - 1)};
+  if (!this->ink_pending_) {
+    this->ink_area_ = dot;
+    this->ink_pending_ = true;
+    return;
+  }
+  this->ink_area_.x0 = std::min(this->ink_area_.x0, dot.x0);
+  this->ink_area_.y0 = std::min(this->ink_area_.y0, dot.y0);
+  this->ink_area_.x1 = std::max(this->ink_area_.x1, dot.x1);
+  this->ink_area_.y1 = std::max(this->ink_area_.y1, dot.y1);
+}
+
+void it8951e::flush_ink_() {
+  //Waits for the engines refreshing the previous strokes, collecting more strokes meanwhile
+  if (!this->ink_pending_ || this->overlaps_inflight_(this->to_panel_area_(this->to_load_area_(this->ink_area_))))
+    return;
+  this->ink_pending_ = false;
+  this->upload_frame_(this->buffer_, this->ink_area_);
+
+  //A2 only drives black and white, tiles that still show gray get DU
+  bool gray = false;
+  for (uint16_t ty = this->ink_area_.y0 / TILE_SIZE; ty <= this->ink_area_.y1 / TILE_SIZE; ty++) {
+    for (uint16_t tx = this->ink_area_.x0 / TILE_SIZE; tx <= this->ink_area_.x1 / TILE_SIZE; tx++)
+      gray |= this->gray_tiles_[ty * this->tiles_x_ + tx];
+  }
+  const DirtyArea area = this->to_panel_area_(this->ink_area_);
+  const uint16_t mode = this->over_gray_asset_(this->ink_area_) ? IT8951_MODE_GC16
+                        : gray                                  ? IT8951_MODE_DU
+                                                                : this->a2_mode_;
+  this->IT8951DisplayArea(area.x0, area.y0, area.x1 - area.x0 + 1, area.y1 - area.y0 + 1, mode);
+  this->track_refresh_(area);
+  this->cover_blits_(area);
+  this->count_ghosting_(this->ink_area_, false);
+  //The panel no longer shows what the frame diff last hashed there, the next update has to look at it again
+  this->forget_tiles_(this->ink_area_);
+  this->flush_direct_updates_();
+  this->last_refresh_ms_ = millis();
+}
+#endif
+
+//-----------------------------------------------------------
+// Update timings
+//  update() and display() fill render_timings_, whoever sends the
+//  frame completes frame_timings_ and flags it, loop() summarizes and
+//  publishes it on the main task.
+//-----------------------------------------------------------
+void TimingSummary::add(uint32_t value) {
+  this->min = std::min(this->min, value);
+  this->max = std::max(this->max, value);
+  this->sum += value;
+  this->count++;
+}
+
+void it8951e::publish_timings_() {
+  const UpdateTimings &timings = this->frame_timings_;
+  this->render_summary_.add(timings.render_us);
+  this->pack_summary_.add(timings.pack_us);
+  this->transfer_summary_.add(timings.transfer_us);
+  this->bytes_summary_.add(timings.bytes);
+  this->busy_summary_.add(timings.busy_us);
+#ifdef USE_SENSOR
+  if (this->render_time_sensor_ != nullptr)
+    this->render_time_sensor_->publish_state(timings.render_us / 1000.0f);
+  if (this->pack_time_sensor_ != nullptr)
+    this->pack_time_sensor_->publish_state(timings.pack_us / 1000.0f);
+  if (this->transfer_time_sensor_ != nullptr)
+    this->transfer_time_sensor_->publish_state(timings.transfer_us / 1000.0f);
+  if (this->bytes_sent_sensor_ != nullptr)
+    this->bytes_sent_sensor_->publish_state(timings.bytes);
+  if (this->busy_wait_time_sensor_ != nullptr)
+    this->busy_wait_time_sensor_->publish_state(timings.busy_us / 1000.0f);
+#endif
+}
+
+void it8951e::publish_lut_time_() {
+  this->lut_summary_.add(this->lut_wait_ms_);
+#ifdef USE_SENSOR
+  if (this->lut_time_sensor_ != nullptr)
+    this->lut_time_sensor_->publish_state(this->lut_wait_ms_);
+#endif
+}
+
+//-----------------------------------------------------------
+// Benchmark
+//  Runs register accesses, a full and a partial update on the live
+//  panel and logs what each cost on the wire. Wire time is modeled
+//  from the byte counts and the configured SPI clocks, the difference
+//  to the measured time is protocol overhead and HRDY waits.
+//-----------------------------------------------------------
+uint32_t it8951e::modeled_wire_us_(const ProtocolStats &stats) {
+  const uint32_t write_rate = std::max<uint32_t>(this->write_data_rate_, 1);
+  const uint32_t read_rate = this->read_data_rate_ != 0 ? this->read_data_rate_ : write_rate;
+  return (uint64_t) stats.bytes_written * 8000000 / write_rate + (uint64_t) stats.bytes_read * 8000000 / read_rate;
+}
+
+void it8951e::benchmark_step_(const char *name, const std::function<void()> &step) {
+  const ProtocolStats before = this->stats_;
+  this->hrdy_waits_ = 0;
+  this->hrdy_wait_us_ = 0;
+  const uint32_t start = micros();
+  step();
+  this->flush_commands_();
+  const uint32_t elapsed = micros() - start;
+
+  ProtocolStats delta;
+  delta.transactions = this->stats_.transactions - before.transactions;
+  delta.bytes_written = this->stats_.bytes_written - before.bytes_written;
+  delta.bytes_read = this->stats_.bytes_read - before.bytes_read;
+  ESP_LOGI(TAG, "Benchmark %s: %u us, %u transactions, %u bytes written, %u bytes read, %u us on the wire, %u us HRDY",
+           name, elapsed, delta.transactions, delta.bytes_written, delta.bytes_read, this->modeled_wire_us_(delta),
+           this->hrdy_wait_us_);
+}
+
+void it8951e::benchmark_tiles_() {
+  //Compresses what buffer_ holds, the frame or the last band, as if it was stored in tiles
+  if (this->tile_raw_.empty()) {
+    this->tile_raw_.resize(TILE_SIZE * TILE_SIZE * this->bits_per_pixel_ / 8);
+    this->tile_packed_.resize(this->tile_raw_.size());
+  }
+  //A band that isn't a whole number of tiles only counts its whole tiles
+  const uint16_t tiles_y = this->frame_rows_ == this->height_ ? this->tiles_y_ : this->frame_rows_ / TILE_SIZE;
+  const int16_t frame_y0 = this->frame_y0_;
+  this->frame_y0_ = 0;
+  uint32_t counts[4] = {};
+  uint32_t tiled_bytes = 0, encode_us = 0, decode_us = 0;
+  for (uint16_t ty = 0; ty < tiles_y; ty++) {
+    for (uint16_t tx = 0; tx < this->tiles_x_; tx++) {
+      uint32_t start = micros();
+      const uint16_t length = this->gather_tile_(tx, ty);
+      const uint8_t *raw = this->tile_raw_.data();
+      const bool uniform = std::none_of(raw + 1, raw + length, [raw](uint8_t b) { return b != raw[0]; });
+      const uint16_t packed = uniform ? 0 : rle_encode(raw, length, this->tile_packed_.data());
+      encode_us += micros() - start;
+
+      const TileKind kind = uniform ? TILE_UNIFORM : packed != 0 ? TILE_RLE : TILE_RAW;
+      const uint16_t stored = kind == TILE_RLE ? packed : kind == TILE_RAW ? length : 0;
+      counts[kind]++;
+      tiled_bytes += sizeof(FrameTile) + (stored + TILE_BLOCK_SIZE - 1) / TILE_BLOCK_SIZE * TILE_BLOCK_SIZE;
+
+      //Decoding writes back the same pixels
+      start = micros();
+      if (kind == TILE_UNIFORM) {
+        memset(this->tile_raw_.data(), raw[0], length);
+      } else if (kind == TILE_RLE) {
+        rle_decode(this->tile_packed_.data(), packed, this->tile_raw_.data());
+      }
+      this->scatter_tile_(tx, ty);
+      decode_us += micros() - start;
+    }
+  }
+  this->frame_y0_ = frame_y0;
+  ESP_LOGI(TAG, "Benchmark tiles: %u bytes flat, %u bytes tiled (%u uniform, %u RLE, %u raw), encode %u us, decode %u us",
+           std::min<uint32_t>(tiles_y * TILE_SIZE, this->frame_rows_) * this->pitch_, tiled_bytes, counts[TILE_UNIFORM], counts[TILE_RLE], counts[TILE_RAW],
+           encode_us, decode_us);
+}
+
+void it8951e::benchmark() {
+  if (this->buffer_ == nullptr)
+    return;
+  this->benchmark_tiles_();
+  if (this->double_buffer_ || this->band_height_ != 0) {
+    ESP_LOGW(TAG, "Update benchmarks need a full frame buffer without double buffering");
+    return;
+  }
+  if (this->lut_busy_)
+    this->IT8951WaitForDisplayReady();
+
+  this->benchmark_step_("register read x16", [this]() {
+    for (int i = 0; i < 16; i++)
+      this->IT8951ReadReg(LUTAFSR);
+  });
+  this->benchmark_step_("register write x16", [this]() {
+    for (int i = 0; i < 16; i++)
+      this->IT8951WriteReg(I80CPCR, 0x0001);
+  });
+
+  //Both updates show what is already in the frame buffer, the panel content doesn't change
+  const uint32_t partial_updates = this->partial_updates_;
+  const DirtyArea full = {0, 0, (int16_t) (this->width_ - 1), (int16_t) (this->height_ - 1)};
+  this->benchmark_step_("full update", [this, &full]() {
+    this->force_full_update_ = true;
+    this->display_frame_(this->buffer_, &full, 1);
+    this->IT8951WaitForDisplayReady();
+  });
+  const int16_t w = std::min<int16_t>(128, this->width_), h = std::min<int16_t>(128, this->height_);
+  const int16_t x = (this->width_ - w) / 2, y = (this->height_ - h) / 2;
+  const DirtyArea partial = {x, y, (int16_t) (x + w - 1), (int16_t) (y + h - 1)};
+  this->benchmark_step_("partial update 128x128", [this, &partial]() {
+    this->partial_updates_ = 0;
+    this->display_frame_(this->buffer_, &partial, 1);
+    this->IT8951WaitForDisplayReady();
+  });
+  this->partial_updates_ = partial_updates;
+
+  ESP_LOGI(TAG, "Totals since boot: %u transactions, %u bytes written, %u bytes read", this->stats_.transactions,
+           this->stats_.bytes_written, this->stats_.bytes_read);
+}
+
+//-----------------------------------------------------------
+// Image cache
+//  Images are uploaded once into controller memory behind the frame
+//  and shown from there with DPY_BUF_AREA. The cache is a page with
+//  the same row stride as the image buffer, filled shelf by shelf.
+//  DPY_BUF_AREA reads (x, y) at addr + y * stride + x, so an image is
+//  shown at (x, y) by passing its own address minus that offset.
+//-----------------------------------------------------------
+uint32_t it8951e::get_cache_addr_() {
+  //One row of scratch space is left for the SPI self-test
+  return this->get_scratch_addr_() + this->gstI80DevInfo.usPanelW;
+}
+
+bool it8951e::check_image_cache_() {
+  if (this->double_buffer_) {
+    ESP_LOGW(TAG, "The image cache is not available with double buffering");
+    return false;
+  }
+  if (this->bits_per_pixel_ == 1 || this->hw_rotate_ != 0 || this->rotation_ != display::DISPLAY_ROTATION_0_DEGREES) {
+    ESP_LOGW(TAG, "The image cache needs 2, 4 or 8 bits per pixel and no rotation");
+    return false;
+  }
+  return this->gulImgBufAddr != 0;
+}
+
+CachedImage *it8951e::find_cached_(const std::string &name) {
+  for (auto &image : this->image_cache_) {
+    if (image.name == name)
+      return &image;
+  }
+  return nullptr;
+}
+
+bool it8951e::is_cached(const std::string &name) { return this->find_cached_(name) != nullptr; }
+
+void it8951e::clear_image_cache() {
+  //Images still on the panel are replaced by the frame underneath
+  for (const auto &blit : this->cached_blits_)
+    this->drop_blit_(blit);
+  this->image_cache_.clear();
+  this->cached_blits_.clear();
+  this->cache_shelf_x_ = 0;
+  this->cache_shelf_y_ = 0;
+  this->cache_shelf_h_ = 0;
+}
+
+bool it8951e::cache_region(const std::string &name, int x, int y, int width, int height) {
+  if (!this->check_image_cache_() || this->buffer_ == nullptr)
+    return false;
+  if (width <= 0 || height <= 0 || x < 0 || x + width > this->width_ || y < this->frame_y0_ ||
+      y + height > this->frame_y0_ + this->frame_rows_) {
+    ESP_LOGW(TAG, "Can't cache '%s', it is not inside the frame buffer", name.c_str());
+    return false;
+  }
+
+  const DirtyArea area = {(int16_t) x, (int16_t) y, (int16_t) (x + width - 1), (int16_t) (y + height - 1)};
+  const IT8951AreaImgInfo stAreaImgInfo = this->align_area_(area);
+  CachedImage *image = this->find_cached_(name);
+  if (image != nullptr) {
+    //Same name again, overwrite it in place if it still fits
+    if (image->width != width || image->height != height || stAreaImgInfo.usWidth > image->slot_width) {
+      ESP_LOGW(TAG, "Can't cache '%s' again with a different size", name.c_str());
+      return false;
+    }
+    //Wherever it is shown the panel has the old pixels
+    const uint16_t index = image - this->image_cache_.data();
+    for (auto &blit : this->cached_blits_) {
+      if (blit.index == index)
+        blit.stale = true;
+    }
+  } else {
+    //Next free spot on the current shelf, or open a new shelf below it
+    const uint16_t stride = this->gstI80DevInfo.usPanelW;
+    if (this->cache_shelf_x_ + stAreaImgInfo.usWidth > stride) {
+      this->cache_shelf_y_ += this->cache_shelf_h_;
+      this->cache_shelf_x_ = 0;
+      this->cache_shelf_h_ = 0;
+    }
+    if (stAreaImgInfo.usWidth > stride ||
+        this->cache_shelf_y_ + height > this->gstI80DevInfo.usPanelH * IMAGE_CACHE_FRAMES) {
+      ESP_LOGW(TAG, "Image cache is full, '%s' not cached", name.c_str());
+      return false;
+    }
+    CachedImage entry;
+    entry.name = name;
+    entry.slot_x = this->cache_shelf_x_;
+    entry.slot_width = stAreaImgInfo.usWidth;
+    entry.cache_y = this->cache_shelf_y_;
+    entry.width = width;
+    entry.height = height;
+    this->cache_shelf_x_ += stAreaImgInfo.usWidth;
+    this->cache_shelf_h_ = std::max<uint16_t>(this->cache_shelf_h_, height);
+    this->image_cache_.push_back(entry);
+    image = &this->image_cache_.back();
+  }
+  //The source keeps its alignment inside the slot
+  image->cache_x = image->slot_x + (x - stAreaImgInfo.usX);
+  image->binary = this->is_binary_area_(this->buffer_, area);
+
+  //Base address that makes the load of (x, y) land at the slot
+  const uint32_t stride = this->gstI80DevInfo.usPanelW;
+  const uint32_t slot_addr = this->get_cache_addr_() + image->cache_y * stride + image->slot_x;
+  this->upload_area_(this->buffer_, area, slot_addr - (y * stride + stAreaImgInfo.usX));
+  ESP_LOGD(TAG, "Cached '%s' (%dx%d) at %u,%u", name.c_str(), width, height, image->cache_x, image->cache_y);
+  return true;
+}
 
-#define BGVR      (DISPLAY_REG_BASE + 0x250)  //Bitmap (1bpp) image color table
-//-------System Registers----------------
-#define SYS_REG_BASE 0x0000
+bool it8951e::show_cached(const std::string &name, int x, int y) {
+  if (!this->check_image_cache_())
+    return false;
+  const CachedImage *image = this->find_cached_(name);
+  if (image == nullptr)
+    return false;
+  if (x < 0 || y < 0 || x + image->width > this->width_ || y + image->height > this->height_) {
+    ESP_LOGW(TAG, "Can't show '%s' at %d,%d, it has to be fully on screen", name.c_str(), x, y);
+    return false;
+  }
 
-//Address of System Registers
-#define I80CPCR (SYS_REG_BASE + 0x04)
-//-------Memory Converter Registers----------------
-#define MCSR_BASE_ADDR 0x0200
-#define MCSR (MCSR_BASE_ADDR  + 0x0000)
-#define LISAR (MCSR_BASE_ADDR + 0x0008)
+  //The writer runs once per strip in banded mode and usually shows the same images every update
+  const uint16_t index = image - this->image_cache_.data();
+  for (auto &blit : this->cached_blits_) {
+    if (blit.index == index && blit.x == x && blit.y == y) {
+      blit.wanted = true;
+      return true;
+    }
+  }
+  this->cached_blits_.push_back({index, (uint16_t) x, (uint16_t) y, true, true});
+  return true;
+}
 
-#define SYS_REG_BASE 0x0000
-#define I80CPCR (SYS_REG_BASE + 0x04)
+static DirtyArea blit_area(const CachedBlit &blit, const CachedImage &image) {
+  return {(int16_t) blit.x, (int16_t) blit.y, (int16_t) (blit.x + image.width - 1),
+          (int16_t) (blit.y + image.height - 1)};
+}
 
-#define USDEF_I80_CMD_GET_DEV_INFO 0x0302
+void it8951e::settle_blits_() {
+  //Images and assets the writer didn't show this time make room for the frame underneath
+  auto it = this->cached_blits_.begin();
+  while (it != this->cached_blits_.end()) {
+    if (it->wanted) {
+      ++it;
+      continue;
+    }
+    this->drop_blit_(*it);
+    it = this->cached_blits_.erase(it);
+  }
+  auto asset = this->placed_assets_.begin();
+  while (asset != this->placed_assets_.end()) {
+    if (asset->wanted) {
+      ++asset;
+      continue;
+    }
+    const DirtyArea area = asset_area(*asset);
+    this->mark_dirty_(area.x0, area.y0, area.x1, area.y1);
+    this->forget_tiles_(area);
+    asset = this->placed_assets_.erase(asset);
+  }
+}
 
-#define IT8951_TCON_REG_WR       0x0011
+void it8951e::drop_blit_(const CachedBlit &blit) {
+  //The frame there didn't change, the diff must not skip it
+  const DirtyArea area = blit_area(blit, this->image_cache_[blit.index]);
+  this->mark_dirty_(area.x0, area.y0, area.x1, area.y1);
+  this->forget_tiles_(area);
+}
 
+void it8951e::cover_blits_(const DirtyArea &panel_area) {
+  //A refresh shows the image buffer, cached images under it have to be shown again
+  for (auto &blit : this->cached_blits_) {
+    if (areas_overlap(blit_area(blit, this->image_cache_[blit.index]), panel_area))
+      blit.stale = true;
+  }
+}
 
-void it8951e::setup_pins_() {
-  this->init_internal_(this->get_buffer_length_());
-//   this->cs_pin_->setup();  // OUTPUT
-//   this->cs_pin_->digital_write(false);
-  if (this->reset_pin_ != nullptr) {
-    this->reset_pin_->setup();  // OUTPUT
-    this->reset_pin_->digital_write(true);
+void it8951e::mark_gray_tiles_(const DirtyArea &area) {
+  for (uint16_t ty = area.y0 / TILE_SIZE; ty <= area.y1 / TILE_SIZE; ty++) {
+    for (uint16_t tx = area.x0 / TILE_SIZE; tx <= area.x1 / TILE_SIZE; tx++)
+      this->gray_tiles_[ty * this->tiles_x_ + tx] = true;
   }
-  if (this->busy_pin_ != nullptr) {
-    this->busy_pin_->setup();  // INPUT
+}
+
+void it8951e::flush_direct_updates_(bool cleanup) {
+  //New assets first, in the order they were drawn. Once streamed, refreshes around them show them as they are.
+  for (size_t i = 0; i < this->placed_assets_.size(); i++) {
+    PlacedAsset &placed = this->placed_assets_[i];
+    if (!placed.stale)
+      continue;
+    const DirtyArea area = asset_area(placed);
+    for (size_t j = i + 1; j < this->placed_assets_.size(); j++) {
+      if (areas_overlap(asset_area(this->placed_assets_[j]), area))
+        this->placed_assets_[j].stale = true;
+    }
+    const DirtyArea panel_area = this->to_panel_area_(area);
+    this->wait_for_area_(panel_area);
+    this->stream_asset_(placed);
+    const uint16_t mode = placed.binary && !cleanup ? IT8951_MODE_DU : IT8951_MODE_GC16;
+    this->IT8951DisplayArea(panel_area.x0, panel_area.y0, panel_area.x1 - panel_area.x0 + 1,
+                            panel_area.y1 - panel_area.y0 + 1, mode);
+    this->track_refresh_(panel_area);
+    this->cover_blits_(panel_area);
+    this->count_ghosting_(area, mode == IT8951_MODE_GC16);
+    if (!placed.binary)
+      this->mark_gray_tiles_(area);
+    placed.stale = false;
   }
-  if (this->en_pin_ != nullptr) {
-    this->en_pin_->setup();  // OUTPUT
-    this->en_pin_->digital_write(true);
+
+  //Then images that aren't on the panel as cached, in the order they were shown
+  const uint32_t stride = this->gstI80DevInfo.usPanelW;
+  for (size_t i = 0; i < this->cached_blits_.size(); i++) {
+    CachedBlit &blit = this->cached_blits_[i];
+    if (!blit.stale)
+      continue;
+    const CachedImage &image = this->image_cache_[blit.index];
+    const DirtyArea area = blit_area(blit, image);
+    //Images shown later stay on top
+    for (size_t j = i + 1; j < this->cached_blits_.size(); j++) {
+      CachedBlit &above = this->cached_blits_[j];
+      if (areas_overlap(blit_area(above, this->image_cache_[above.index]), area))
+        above.stale = true;
+    }
+    const uint32_t image_addr = this->get_cache_addr_() + image.cache_y * stride + image.cache_x;
+    //After a cleanup they are cleaned up as well, DU would count as ghosting again
+    const uint16_t mode = image.binary && !cleanup ? IT8951_MODE_DU : IT8951_MODE_GC16;
+    this->wait_for_area_(area);
+    this->IT8951DisplayAreaBuf(blit.x, blit.y, image.width, image.height, mode,
+                               image_addr - (blit.y * stride + blit.x));
+    this->track_refresh_(area);
+    this->count_ghosting_(area, mode == IT8951_MODE_GC16);
+    if (!image.binary)
+      this->mark_gray_tiles_(area);
+    blit.stale = false;
   }
-  this->spi_setup();
+}
 
-  this->reset_();
+//-----------------------------------------------------------
+// Flash assets
+//  RLE compressed 4bpp images generated by display.py. draw_asset() only
+//  records where the writer placed them; flush_direct_updates_() decodes
+//  new ones a row at a time straight into an LD_IMG_AREA transfer, so the
+//  frame buffer never holds them. Frame uploads go around their areas,
+//  which keeps them in image memory until the writer stops drawing them.
+//  A control byte c with the top bit set repeats the next byte
+//  (c & 0x7F) + 1 times, otherwise c + 1 literal bytes follow.
+//-----------------------------------------------------------
+bool it8951e::draw_asset(int x, int y, const IT8951Asset *asset) {
+  if (this->double_buffer_ || this->bits_per_pixel_ == 1 || this->gulImgBufAddr == 0) {
+    ESP_LOGW(TAG, "Assets need 2, 4 or 8 bits per pixel and no double buffering");
+    return false;
+  }
+  //Frame loads are word aligned, both edges of the area have to be so they don't reach into it
+  const uint16_t align = this->bits_per_pixel_ == 2 ? 8 : 4;
+  const int width = (asset->get_width() + align - 1) / align * align;
+  if (x % align != 0 || x < 0 || y < 0 || x + width > this->width_ || y + asset->get_height() > this->height_) {
+    ESP_LOGW(TAG, "Can't draw asset at %d,%d, it has to be fully on screen with x a multiple of %u", x, y, align);
+    return false;
+  }
+
+  //The writer runs once per strip in banded mode and usually draws the same assets every update
+  for (auto &placed : this->placed_assets_) {
+    if (placed.asset == asset && placed.x == x && placed.y == y) {
+      placed.wanted = true;
+      return true;
+    }
+  }
+  this->placed_assets_.push_back({asset, (uint16_t) x, (uint16_t) y, (uint16_t) width, true, true, false});
+  return true;
 }
 
-void it8951e::initialize() {
-  this->reset_();
+void it8951e::stream_asset_(PlacedAsset &placed) {
+  const IT8951Asset *asset = placed.asset;
+  IT8951LdImgInfo stLdImgInfo;
+  stLdImgInfo.usEndianType = IT8951_LDIMG_B_ENDIAN; //Same byte order as the frame rows
+  stLdImgInfo.usPixelFormat = IT8951_4BPP; //Assets are always 4bpp, whatever the frame uses
+  stLdImgInfo.usRotate = this->hw_rotate_; //Rotate mode
+  stLdImgInfo.ulImgBufBaseAddr = this->gulImgBufAddr;
+  IT8951AreaImgInfo stAreaImgInfo = {placed.x, placed.y, placed.width, asset->get_height()};
+
+  this->IT8951SetImgBufBaseAddr(stLdImgInfo.ulImgBufBaseAddr);
+  this->IT8951LoadImgAreaStart(&stLdImgInfo, &stAreaImgInfo);
+  this->LCDStartWriteData();
+  //Padding past the asset's own load width stays white
+  std::vector<uint8_t> &row = this->row_scratch_;
+  row.assign(placed.width / 2, 0xFF);
+  const uint16_t row_bytes = asset->get_load_width() / 2;
+  const uint8_t *p = asset->get_data();
+  const uint8_t *end = p + asset->get_length();
+  //A truncated asset reads as white from where it ends
+  bool truncated = false;
+  auto next = [&]() -> uint8_t {
+    if (p < end)
+      return progmem_read_byte(p++);
+    truncated = true;
+    return 0xFF;
+  };
+  uint8_t count = 0, value = 0;
+  bool run = false;
+  bool binary = true;
+  //Runs carry over from one row to the next
+  for (uint16_t j = 0; j < asset->get_height(); j++) {
+    for (uint16_t i = 0; i < row_bytes; i++) {
+      if (count == 0) {
+        const uint8_t control = next();
+        count = (control & 0x7F) + 1;
+        run = (control & 0x80) != 0;
+        if (run)
+          value = next();
+      }
+      const uint8_t b = run ? value : next();
+      count--;
+      row[i] = b;
+      binary = binary && ((b & 0x0F) == 0x00 || (b & 0x0F) == 0x0F) && ((b & 0xF0) == 0x00 || (b & 0xF0) == 0xF0);
+    }
+    this->LCDWriteDataBytes(row.data(), row.size());
+  }
+  this->LCDEndWriteData();
+  this->IT8951LoadImgEnd();
+  if (truncated)
+    ESP_LOGW(TAG, "Asset at %u,%u is truncated", placed.x, placed.y);
+  placed.binary = binary;
+}
 
-  //Get Device Info
-  this->GetIT8951SystemInfo();
+bool it8951e::over_gray_asset_(const DirtyArea &area) {
+  //Refreshing the frame around an asset refreshes the asset too, DU and A2 can't show its gray
+  for (const auto &placed : this->placed_assets_) {
+    if (!placed.binary && areas_overlap(asset_area(placed), area))
+      return true;
+  }
+  return false;
+}
 
-  if (!this->gstI80DevInfo.usPanelW || !this->gstI80DevInfo.usPanelH) {
+void it8951e::upload_frame_(const uint8_t *frame, const DirtyArea &area, size_t first) {
+  //Assets keep their area of image memory, the frame is only sent around them
+  for (size_t i = first; i < this->placed_assets_.size(); i++) {
+    const DirtyArea hole = asset_area(this->placed_assets_[i]);
+    if (!areas_overlap(hole, area))
+      continue;
+    if (area.y0 < hole.y0)
+      this->upload_frame_(frame, {area.x0, area.y0, area.x1, (int16_t) (hole.y0 - 1)}, i + 1);
+    if (area.y1 > hole.y1)
+      this->upload_frame_(frame, {area.x0, (int16_t) (hole.y1 + 1), area.x1, area.y1}, i + 1);
+    const int16_t y0 = std::max(area.y0, hole.y0), y1 = std::min(area.y1, hole.y1);
+    if (area.x0 < hole.x0)
+      this->upload_frame_(frame, {area.x0, y0, (int16_t) (hole.x0 - 1), y1}, i + 1);
+    if (area.x1 > hole.x1)
+      this->upload_frame_(frame, {(int16_t) (hole.x1 + 1), y0, area.x1, y1}, i + 1);
     return;
   }
+  this->upload_area_(frame, area, this->gulImgBufAddr);
+}
 
-  this->gulImgBufAddr = this->gstI80DevInfo.usImgBufAddrL | ((uint32_t)this->gstI80DevInfo.usImgBufAddrH << 16);
+//-----------------------------------------------------------
+// Double buffered pipeline
+//  The writer renders into buffer_ while a separate task streams
+//  front_buffer_ to the controller. swap_buffers_() is the only place
+//  the two meet and only runs while the task is idle.
+//-----------------------------------------------------------
+bool it8951e::start_pipeline_() {
+  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+  this->front_buffer_ = allocator.allocate(this->get_buffer_length_());
+  if (this->front_buffer_ == nullptr) {
+    ESP_LOGE(TAG, "Could not allocate front buffer, double buffering disabled");
+    this->double_buffer_ = false;
+    return false;
+  }
+  memcpy(this->front_buffer_, this->buffer_, this->get_buffer_length_());
+
+#ifdef USE_ESP32
+  //The main loop runs on core 1, keep the SPI transfer and LUT polling on core 0
+  if (xTaskCreatePinnedToCore(pipeline_task_, "it8951e", 4096, this, 1, &this->pipeline_task_handle_, 0) != pdPASS) {
+    ESP_LOGE(TAG, "Could not start display task, double buffering disabled");
+    this->double_buffer_ = false;
+    return false;
+  }
+#else
+  this->pipeline_thread_ = std::thread(pipeline_task_, this);
+#endif
+  return true;
+}
 
-  //Set to Enable I80 Packed mode
-  this->IT8951WriteReg(I80CPCR, 0x0001);
+void it8951e::stop_pipeline_() {
+#ifdef USE_ESP32
+  if (this->pipeline_task_handle_ == nullptr)
+    return;
+  //Between frames the task only waits for its notification, nothing is left half sent
+  while (this->pipeline_busy_)
+    delay(1);
+  vTaskDelete(this->pipeline_task_handle_);
+  this->pipeline_task_handle_ = nullptr;
+#else
+  if (!this->pipeline_thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(this->pipeline_mutex_);
+    this->pipeline_stop_ = true;
+  }
+  this->pipeline_cv_.notify_one();
+  this->pipeline_thread_.join();
+#endif
 }
 
-void it8951e::enablePower() { this->en_pin_->digital_write(true); }
-void it8951e::disablePower() { this->en_pin_->digital_write(false); }
+it8951e::~it8951e() { this->stop_pipeline_(); }
+
+void it8951e::pipeline_task_(void *arg) {
+  auto *self = static_cast<it8951e *>(arg);
+  while (true) {
+#ifdef USE_ESP32
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#else
+    {
+      std::unique_lock<std::mutex> lock(self->pipeline_mutex_);
+      self->pipeline_cv_.wait(lock, [self] { return self->pipeline_busy_.load() || self->pipeline_stop_.load(); });
+    }
+    if (self->pipeline_stop_)
+      return;
+#endif
+    //HRDY waits share the task notification, only a handed over frame counts
+    if (!self->pipeline_busy_)
+      continue;
+    self->display_frame_(self->front_buffer_, self->front_areas_, self->front_count_);
+    //The task owns the bus until the refresh is done, so the LUT time, idle standby and the
+    //ghosting cleanup see the engines go idle without loop() touching the bus in between
+    self->IT8951WaitForDisplayReady();
+    self->pipeline_busy_ = false;
+  }
+}
 
-float it8951e::get_setup_priority() const { return setup_priority::PROCESSOR; }
+void it8951e::swap_buffers_() {
+  if (this->pipeline_busy_)
+    return;
+  this->frame_pending_ = false;
+  if (this->dirty_count_ == 0)
+    return;
+  //The frame waits in the back buffer, drawing on top of it, until min_refresh_interval is over
+  const uint32_t now = millis();
+  const uint32_t wait = this->region_wait_(this->background_region_, now);
+  if (wait != 0) {
+    this->frame_pending_ = true;
+    this->schedule_retry_ = now + wait;
+    return;
+  }
 
-void it8951e::update() {
-  this->do_update_();
-  this->display();
+  const uint32_t start = micros();
+  this->coalesce_dirty_();
+  if (this->frame_diff_) {
+    this->diff_dirty_(this->buffer_);
+    if (this->dirty_count_ == 0)
+      return;
+  }
+  this->background_region_.refreshed = true;
+  this->background_region_.last_refresh = now;
+  std::swap(this->buffer_, this->front_buffer_);
+  memcpy(this->front_areas_, this->dirty_areas_, sizeof(DirtyArea) * this->dirty_count_);
+  this->front_count_ = this->dirty_count_;
+  this->dirty_count_ = 0;
+
+  //The new back buffer still holds the previous frame, bring the changed rows up to date
+  for (uint8_t i = 0; i < this->front_count_; i++) {
+    const DirtyArea &area = this->front_areas_[i];
+    const uint32_t offset = area.y0 * this->pitch_;
+    memcpy(this->buffer_ + offset, this->front_buffer_ + offset, (area.y1 - area.y0 + 1) * this->pitch_);
+  }
+  this->render_timings_.pack_us = micros() - start;
+  this->frame_timings_ = this->render_timings_;
+
+  this->pipeline_busy_ = true;
+#ifdef USE_ESP32
+  xTaskNotifyGive(this->pipeline_task_handle_);
+#else
+  {
+    std::lock_guard<std::mutex> lock(this->pipeline_mutex_);
+  }
+  this->pipeline_cv_.notify_one();
+#endif
 }
-void it8951e::fill(Color color) {
-  // flip logic
-  const uint8_t fill = ((color.white << 4) & 0xF) | (color.white & 0xF);
-  for (uint32_t i = 0; i < this->get_buffer_length_(); i++)
-    this->buffer_[i] = fill;
+
+bool it8951e::is_binary_area_(const uint8_t *frame, const DirtyArea &area) {
+  //Scan the same word aligned span upload_area_() sends, 32 bits per load.
+  //A pixel is black or white exactly when each of its bits equals its neighbour.
+  uint32_t mask;
+  switch (this->bits_per_pixel_) {
+    case 1:
+      return true;
+    case 2:
+      mask = 0x55555555;
+      break;
+    case 4:
+      mask = 0x77777777;
+      break;
+    default:
+      mask = 0x7F7F7F7F;
+      break;
+  }
+  const IT8951AreaImgInfo stAreaImgInfo = this->align_area_(area);
+  const uint32_t x0 = stAreaImgInfo.usX * this->bits_per_pixel_ / 8;
+  const uint32_t x1 = x0 + stAreaImgInfo.usWidth * this->bits_per_pixel_ / 8;
+  for (int y = area.y0; y <= area.y1; y++) {
+    const uint8_t *row = frame + (y - this->frame_y0_) * this->pitch_;
+    uint32_t x = x0;
+    for (; x + 4 <= x1; x += 4) {
+      uint32_t w;
+      memcpy(&w, row + x, 4);
+      if ((w ^ (w >> 1)) & mask)
+        return false;
+    }
+    for (; x < x1; x++) {
+      if ((row[x] ^ (row[x] >> 1)) & mask & 0xFF)
+        return false;
+    }
+  }
+  return true;
 }
-void HOT it8951e::draw_absolute_pixel_internal(int x, int y, Color color) {
-  if (x >= pstDevInfo->usPanelW || y >= pstDevInfo->usPanelH || x < 0 || y < 0)
-    return;
 
-  const uint32_t pos = (x + y * pstDevInfo->usPanelW) / 2u;
-  const uint8_t subpos = x % 2;
-  // flip logic
-  this->buffer_[pos] = ((color.white << 4) & 0xF) >> subpos * 4;
+uint16_t it8951e::select_waveform_(const uint8_t *frame, const DirtyArea &area) {
+  const uint16_t tx0 = area.x0 / TILE_SIZE, tx1 = area.x1 / TILE_SIZE;
+  const uint16_t ty0 = area.y0 / TILE_SIZE, ty1 = area.y1 / TILE_SIZE;
+
+  bool binary = this->binary_waveform_ != BINARY_WAVEFORM_GC16 && this->is_binary_area_(frame, area);
+  //A2 only drives black/white to black/white, gray leftovers underneath need DU or GC16
+  bool gray_before = false;
+  for (uint16_t ty = ty0; ty <= ty1; ty++) {
+    for (uint16_t tx = tx0; tx <= tx1; tx++) {
+      std::vector<bool>::reference gray = this->gray_tiles_[ty * this->tiles_x_ + tx];
+      gray_before |= gray;
+      if (!binary) {
+        gray = true;
+        continue;
+      }
+      //A partly covered tile still shows its old pixels outside the area. Those match the frame
+      //unless they are waiting to be sent, then the tile may still hold gray. The pipeline task's
+      //frame has no such areas, dirty_areas_ already belongs to the next one then.
+      const DirtyArea tile = {(int16_t) (tx * TILE_SIZE), (int16_t) (ty * TILE_SIZE),
+                              (int16_t) (std::min<int>((tx + 1) * TILE_SIZE, this->width_) - 1),
+                              (int16_t) (std::min<int>((ty + 1) * TILE_SIZE, this->height_) - 1)};
+      const bool covered = area.x0 <= tile.x0 && area.y0 <= tile.y0 && area.x1 >= tile.x1 && area.y1 >= tile.y1;
+      if (covered ||
+          (gray && (this->double_buffer_ || !this->overlaps_dirty_(tile)) && this->is_binary_area_(frame, tile)))
+        gray = false;
+    }
+  }
+
+  if (!binary)
+    return IT8951_MODE_GC16;
+  if (this->binary_waveform_ == BINARY_WAVEFORM_A2 && !gray_before)
+    return this->a2_mode_;
+  return IT8951_MODE_DU;
 }
 
-void it8951e::display(){
+IT8951AreaImgInfo it8951e::align_area_(const DirtyArea &area) {
+  //Packed pixels are sent in whole words, 1bpp additionally needs 4 byte alignment on some panels
+  const uint16_t usAlign = this->bits_per_pixel_ == 1 ? 32 : 16 / this->bits_per_pixel_;
+  IT8951AreaImgInfo stAreaImgInfo;
+  stAreaImgInfo.usX = area.x0 & ~(usAlign - 1);
+  stAreaImgInfo.usY = area.y0;
+  stAreaImgInfo.usWidth = ((area.x1 | (usAlign - 1)) + 1) - stAreaImgInfo.usX;
+  stAreaImgInfo.usHeight = area.y1 - area.y0 + 1;
+  return stAreaImgInfo;
+}
+
+void it8951e::upload_area_(const uint8_t *frame, const DirtyArea &area, uint32_t image_addr) {
+  IT8951LdImgInfo stLdImgInfo;
+  stLdImgInfo.usEndianType = IT8951_LDIMG_B_ENDIAN; //Rows go out straight from the frame, no byte swapping
+  stLdImgInfo.usRotate = this->hw_rotate_; //Rotate mode
+  stLdImgInfo.ulStartFBAddr = (uintptr_t)frame; //Start address of source Frame buffer
+  stLdImgInfo.ulImgBufBaseAddr = image_addr;//Base address of target image buffer
+
+  IT8951AreaImgInfo stAreaImgInfo = this->align_area_(area);
+  switch (this->bits_per_pixel_) {
+    case 1:
+      //Each 8bpp "pixel" carries 8 real pixels
+      stLdImgInfo.usPixelFormat = IT8951_8BPP;
+      stAreaImgInfo.usX /= 8;
+      stAreaImgInfo.usWidth /= 8;
+      break;
+    case 2:
+      stLdImgInfo.usPixelFormat = IT8951_2BPP;
+      break;
+    case 4:
+      stLdImgInfo.usPixelFormat = IT8951_4BPP;
+      break;
+    default:
+      stLdImgInfo.usPixelFormat = IT8951_8BPP;
+      break;
+  }
 
-  uint32_t i,j;
-  //Source buffer address of Host
-  uint16_t* pusFrameBuf = (uint16_t*)this->buffer_;
+  this->IT8951HostAreaPackedPixelWrite(&stLdImgInfo, &stAreaImgInfo);
+}
 
-  IT8951DevInfo* pstDevInfo;
-  pstDevInfo = (IT8951DevInfo*)this->gstI80DevInfo;
-
-  IT8951LdImgInfo pstLdImgInfo;
-  pstLdImgInfo.usEndianType = IT8951_LDIMG_L_ENDIAN; //little or Big Endian
-  pstLdImgInfo.usPixelFormat = IT8951_4BPP; //bpp
-  pstLdImgInfo.usRotate = IT8951_ROTATE_0; //Rotate mode
-  pstLdImgInfo.ulStartFBAddr = self->buffer_; //Start address of source Frame buffer
-  pstLdImgInfo.ulImgBufBaseAddr = pstDevInfo->usImgBufAddrL | (pstDevInfo->usImgBufAddrH << 16);//Base address of target image buffer
-  IT8951AreaImgInfo pstAreaImgInfo;
-  pstAreaImgInfo.usX = 0;
-  pstAreaImgInfo.usY = 0;
-  pstAreaImgInfo.usWidth = pstDevInfo->usPanelW;
-  pstAreaImgInfo.usHeight = pstDevInfo->usPanelH;
+uint32_t it8951e::get_buffer_length_() { return this->pitch_ * this->frame_rows_; }
 
-  //Set Image buffer(IT8951) Base address
-  this->IT8951SetImgBufBaseAddr(pstLdImgInfo.ulImgBufBaseAddr);
-  //Send Load Image start Cmd
-  this->IT8951LoadImgAreaStart(&pstLdImgInfo , &pstAreaImgInfo);
-  //Host Write Data
-  for(j=0;j< pstAreaImgInfo->usHeight;j++)
-  {
-     for(i=0;i< pstAreaImgInfo->usWidth/2;i++)
-      {
-          //Write a Word(2-Bytes) for each time
-          this->LCDWriteData(*pusFrameBuf);
-          pusFrameBuf++;
-      }
+uint32_t it8951e::get_scratch_addr_() {
+  //The controller keeps the displayed image at 8bpp, off-screen memory starts right after it
+  return this->gulImgBufAddr + (uint32_t) this->gstI80DevInfo.usPanelW * this->gstI80DevInfo.usPanelH;
+}
+
+DirtyArea it8951e::to_panel_area_(const DirtyArea &area) {
+  //Load areas are given in host coordinates, display areas in panel coordinates.
+  //Same mapping DisplayBuffer::draw_pixel_at() applies for software rotation.
+  const int16_t w = this->gstI80DevInfo.usPanelW, h = this->gstI80DevInfo.usPanelH;
+  switch (this->hw_rotate_) {
+    case IT8951_ROTATE_90:
+      return DirtyArea{(int16_t) (w - 1 - area.y1), area.x0, (int16_t) (w - 1 - area.y0), area.x1};
+    case IT8951_ROTATE_180:
+      return DirtyArea{(int16_t) (w - 1 - area.x1), (int16_t) (h - 1 - area.y1), (int16_t) (w - 1 - area.x0),
+                       (int16_t) (h - 1 - area.y0)};
+    case IT8951_ROTATE_270:
+      return DirtyArea{area.y0, (int16_t) (h - 1 - area.x1), area.y1, (int16_t) (h - 1 - area.x0)};
+    default:
+      return area;
   }
-  //Send Load Img End Command
-  this->IT8951LoadImgEnd();
 }
-uint32_t it8951e::get_buffer_length_() { return pstDevInfo->usPanelW * pstDevInfo->usPanelH; }
 void it8951e::on_safe_shutdown() { this->deep_sleep(); }
 
 
@@ -208,7 +2750,7 @@ void it8951e::on_safe_shutdown() { this->deep_sleep(); }
 
 void it8951e::GetIT8951SystemInfo()
 {
-  uint16_t* pusWord = (uint16_t*)this->gstI80DevInfo;
+  uint16_t* pusWord = (uint16_t*)&this->gstI80DevInfo;
   IT8951DevInfo* pstDevInfo;
 
   //Send I80 CMD
@@ -218,7 +2760,7 @@ void it8951e::GetIT8951SystemInfo()
   this->LCDReadNData(pusWord, sizeof(IT8951DevInfo)/2);//Polling HRDY for each words(2-bytes) if possible
   
   //Show Device information of IT8951
-  pstDevInfo = (IT8951DevInfo*)this->gstI80DevInfo;
+  pstDevInfo = &this->gstI80DevInfo;
   ESP_LOGD(TAG, "Panel(W,H) = (%d,%d)\r\n",
   pstDevInfo->usPanelW, pstDevInfo->usPanelH );
   ESP_LOGD(TAG, "Image Buffer Address = %X\r\n",
@@ -238,10 +2780,8 @@ void it8951e::IT8951LoadImgStart(IT8951LdImgInfo* pstLdImgInfo)
     usArg = (pstLdImgInfo->usEndianType << 8 )
     |(pstLdImgInfo->usPixelFormat << 4)
     |(pstLdImgInfo->usRotate);
-    //Send Cmd
-    this->LCDWriteCmdCode(IT8951_TCON_LD_IMG);
-    //Send Arg
-    this->LCDWriteData(usArg);
+    //Send Cmd and Arg
+    this->queue_command_(IT8951_TCON_LD_IMG, &usArg, 1);
 }
 //-----------------------------------------------------------
 //Host Cmd 11---LD_IMG_AREA
@@ -258,14 +2798,14 @@ void it8951e::IT8951LoadImgAreaStart(IT8951LdImgInfo* pstLdImgInfo ,IT8951AreaIm
     usArg[3] = pstAreaImgInfo->usWidth;
     usArg[4] = pstAreaImgInfo->usHeight;
     //Send Cmd and Args
-    this->LCDSendCmdArg(IT8951_TCON_LD_IMG_AREA , usArg , 5);
+    this->queue_command_(IT8951_TCON_LD_IMG_AREA , usArg , 5);
 }
 //-----------------------------------------------------------
 //Host Cmd 12---LD_IMG_END
 //-----------------------------------------------------------
 void it8951e::IT8951LoadImgEnd(void)
 {
-    this->LCDWriteCmdCode(IT8951_TCON_LD_IMG_END);
+    this->queue_command_(IT8951_TCON_LD_IMG_END, nullptr, 0);
 }
 
 //-----------------------------------------------------------
@@ -275,9 +2815,65 @@ void it8951e::IT8951SetImgBufBaseAddr(uint32_t ulImgBufAddr)
 {
   uint16_t usWordH = (uint16_t)((ulImgBufAddr >> 16) & 0x0000FFFF);
   uint16_t usWordL = (uint16_t)( ulImgBufAddr & 0x0000FFFF);
-  //Write LISAR Reg
-  this->IT8951WriteReg(LISAR + 2 ,usWordH);
-  this->IT8951WriteReg(LISAR ,usWordL);
+  //Write LISAR Reg, only the halves that differ from what it already holds
+  const uint32_t ulOld = this->lisar_;
+  this->lisar_ = ulImgBufAddr;
+  if (ulOld == UINT32_MAX || (ulOld >> 16) != usWordH)
+    this->IT8951WriteReg(LISAR + 2 ,usWordH);
+  if (ulOld == UINT32_MAX || (ulOld & 0xFFFF) != usWordL)
+    this->IT8951WriteReg(LISAR ,usWordL);
+}
+
+//-----------------------------------------------------------
+//Host Cmd 12-15---MEM_BST_RD_T / MEM_BST_RD_S / MEM_BST_WR / MEM_BST_END
+//-----------------------------------------------------------
+void it8951e::IT8951MemBurstReadTrigger(uint32_t ulMemAddr, uint32_t ulReadSize)
+{
+  uint16_t usArg[4];
+  //Setting Arguments for Memory Burst Read
+  usArg[0] = (uint16_t)(ulMemAddr & 0x0000FFFF); //addr[15:0]
+  usArg[1] = (uint16_t)((ulMemAddr >> 16) & 0x0000FFFF); //addr[25:16]
+  usArg[2] = (uint16_t)(ulReadSize & 0x0000FFFF); //Cnt[15:0]
+  usArg[3] = (uint16_t)((ulReadSize >> 16) & 0x0000FFFF); //Cnt[25:16]
+  //Send Cmd and Arg
+  this->queue_command_(IT8951_TCON_MEM_BST_RD_T, usArg, 4);
+}
+
+void it8951e::IT8951MemBurstReadStart()
+{
+  this->LCDWriteCmdCode(IT8951_TCON_MEM_BST_RD_S);
+}
+
+void it8951e::IT8951MemBurstWrite(uint32_t ulMemAddr, uint32_t ulWriteSize)
+{
+  uint16_t usArg[4];
+  //Setting Arguments for Memory Burst Write
+  usArg[0] = (uint16_t)(ulMemAddr & 0x0000FFFF); //addr[15:0]
+  usArg[1] = (uint16_t)((ulMemAddr >> 16) & 0x0000FFFF); //addr[25:16]
+  usArg[2] = (uint16_t)(ulWriteSize & 0x0000FFFF); //Cnt[15:0]
+  usArg[3] = (uint16_t)((ulWriteSize >> 16) & 0x0000FFFF); //Cnt[25:16]
+  //Send Cmd and Arg
+  this->queue_command_(IT8951_TCON_MEM_BST_WR, usArg, 4);
+}
+
+void it8951e::IT8951MemBurstEnd(void)
+{
+  this->queue_command_(IT8951_TCON_MEM_BST_END, nullptr, 0);
+}
+
+void it8951e::IT8951MemBurstWriteProc(uint32_t ulMemAddr, uint32_t ulWriteSize, uint16_t* pSrcBuf)
+{
+  this->IT8951MemBurstWrite(ulMemAddr, ulWriteSize);
+  this->LCDWriteNData(pSrcBuf, ulWriteSize);
+  this->IT8951MemBurstEnd();
+}
+
+void it8951e::IT8951MemBurstReadProc(uint32_t ulMemAddr, uint32_t ulReadSize, uint16_t* pBuf)
+{
+  this->IT8951MemBurstReadTrigger(ulMemAddr, ulReadSize);
+  this->IT8951MemBurstReadStart();
+  this->LCDReadNData(pBuf, ulReadSize);
+  this->IT8951MemBurstEnd();
 }
 
 //-----------------------------------------------------------
@@ -291,7 +2887,96 @@ void it8951e::IT8951SetImgBufBaseAddr(uint32_t ulImgBufAddr)
 void it8951e::IT8951WaitForDisplayReady()
 {
   //Check IT8951 Register LUTAFSR => NonZero Busy, 0 - Free
-  while(this->IT8951ReadReg(LUTAFSR));
+  //Back off between polls, every poll is a full register read round trip
+  while (this->lut_busy_)
+  {
+    const uint32_t now = millis();
+    if ((int32_t)(now - this->lut_next_poll_) < 0)
+      delay(this->lut_next_poll_ - now);
+    this->poll_display_ready_();
+  }
+}
+
+void it8951e::poll_display_ready_()
+{
+  if (!this->lut_busy_ || (int32_t)(millis() - this->lut_next_poll_) < 0)
+    return;
+  this->retire_inflight_(this->IT8951ReadReg(LUTAFSR));
+  if (this->inflight_count_ == 0)
+  {
+    this->lut_busy_ = false;
+    this->lut_wait_ms_ = millis() - this->lut_start_;
+    this->lut_ready_ = true;
+    ESP_LOGD(TAG, "LUT engines idle after %u ms", this->lut_wait_ms_);
+    if (this->idle_standby_)
+      this->standby();
+    return;
+  }
+  this->lut_backoff_ = std::min<uint32_t>(this->lut_backoff_ * 2, this->busy_backoff_);
+  this->lut_next_poll_ = millis() + this->lut_backoff_;
+}
+
+//-----------------------------------------------------------
+// In-flight refreshes
+//  Every display command is recorded with its panel area and the LUT
+//  engines that turned busy when it was issued (LUTAFSR has one bit per
+//  engine). An area is done once its engines are idle again. Only new
+//  work overlapping an in-flight area has to wait for it.
+//-----------------------------------------------------------
+DirtyArea it8951e::to_load_area_(const DirtyArea &area) {
+  //The span upload_area_() actually writes, widened to whole words
+  const IT8951AreaImgInfo stAreaImgInfo = this->align_area_(area);
+  return {(int16_t) stAreaImgInfo.usX, area.y0, (int16_t) (stAreaImgInfo.usX + stAreaImgInfo.usWidth - 1), area.y1};
+}
+
+bool it8951e::overlaps_inflight_(const DirtyArea &panel_area) {
+  for (uint8_t i = 0; i < this->inflight_count_; i++) {
+    if (areas_overlap(this->inflight_[i].area, panel_area))
+      return true;
+  }
+  return false;
+}
+
+void it8951e::retire_inflight_(uint16_t engines_busy) {
+  //Areas whose engine couldn't be told apart (mask 0) only retire once everything is idle
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < this->inflight_count_; i++) {
+    const InflightArea &inflight = this->inflight_[i];
+    const bool done = engines_busy == 0 || (inflight.engines != 0 && (inflight.engines & engines_busy) == 0);
+    if (!done)
+      this->inflight_[n++] = inflight;
+  }
+  this->inflight_count_ = n;
+}
+
+void it8951e::track_refresh_(const DirtyArea &panel_area) {
+  if (this->inflight_count_ == MAX_INFLIGHT_AREAS)
+    this->IT8951WaitForDisplayReady();
+
+  const uint16_t busy = this->IT8951ReadReg(LUTAFSR);
+  this->retire_inflight_(busy);
+  uint16_t known = 0;
+  for (uint8_t i = 0; i < this->inflight_count_; i++)
+    known |= this->inflight_[i].engines;
+  this->inflight_[this->inflight_count_++] = {panel_area, (uint16_t) (busy & ~known)};
+
+  const uint32_t now = millis();
+  if (!this->lut_busy_)
+    this->lut_start_ = now;
+  this->lut_busy_ = true;
+  this->lut_next_poll_ = now;
+  this->lut_backoff_ = 1;
+}
+
+void it8951e::wait_for_area_(const DirtyArea &panel_area)
+{
+  while (this->lut_busy_ && this->overlaps_inflight_(panel_area))
+  {
+    const uint32_t now = millis();
+    if ((int32_t)(now - this->lut_next_poll_) < 0)
+      delay(this->lut_next_poll_ - now);
+    this->poll_display_ready_();
+  }
 }
 
 //-----------------------------------------------------------
@@ -299,24 +2984,36 @@ void it8951e::IT8951WaitForDisplayReady()
 //-----------------------------------------------------------
 void it8951e::IT8951HostAreaPackedPixelWrite(IT8951LdImgInfo* pstLdImgInfo,IT8951AreaImgInfo* pstAreaImgInfo)
 {
-  uint32_t i,j;
-  //Source buffer address of Host
-  uint16_t* pusFrameBuf = (uint16_t*)pstLdImgInfo->ulStartFBAddr;
+  //Source is the full host frame buffer, rows are pitch_ bytes apart
+  const uint8_t* pucFrameBuf = (const uint8_t*)pstLdImgInfo->ulStartFBAddr;
+  const uint32_t ulPitch = this->pitch_;
+  const uint32_t ulBits = pstLdImgInfo->usPixelFormat == IT8951_2BPP   ? 2
+                          : pstLdImgInfo->usPixelFormat == IT8951_4BPP ? 4
+                                                                       : 8;
+  const uint32_t ulRowByteCnt = pstAreaImgInfo->usWidth * ulBits / 8;
 
   //Set Image buffer(IT8951) Base address
   this->IT8951SetImgBufBaseAddr(pstLdImgInfo->ulImgBufBaseAddr);
   //Send Load Image start Cmd
   this->IT8951LoadImgAreaStart(pstLdImgInfo , pstAreaImgInfo);
-  //Host Write Data
-  for(j=0;j< pstAreaImgInfo->usHeight;j++)
+  //Host Write Data, the whole area goes out under a single data preamble.
+  //Loaded big endian, rows are sent as they are in memory.
+  this->LCDStartWriteData();
+  pucFrameBuf += (pstAreaImgInfo->usY - this->frame_y0_) * ulPitch + pstAreaImgInfo->usX * ulBits / 8;
+  if (ulRowByteCnt == ulPitch)
   {
-     for(i=0;i< pstAreaImgInfo->usWidth/2;i++)
-      {
-          //Write a Word(2-Bytes) for each time
-          this->LCDWriteData(*pusFrameBuf);
-          pusFrameBuf++;
-      }
+    //Full width rows are contiguous
+    this->LCDWriteDataBytes(pucFrameBuf, ulRowByteCnt * pstAreaImgInfo->usHeight);
+  }
+  else
+  {
+    for (uint32_t j = 0; j < pstAreaImgInfo->usHeight; j++)
+    {
+      this->LCDWriteDataBytes(pucFrameBuf, ulRowByteCnt);
+      pucFrameBuf += ulPitch;
+    }
   }
+  this->LCDEndWriteData();
   //Send Load Img End Command
   this->IT8951LoadImgEnd();
 }
@@ -326,14 +3023,21 @@ void it8951e::IT8951HostAreaPackedPixelWrite(IT8951LdImgInfo* pstLdImgInfo,IT895
 //-----------------------------------------------------------
 void it8951e::IT8951DisplayArea(uint16_t usX, uint16_t usY, uint16_t usW, uint16_t usH, uint16_t usDpyMode)
 {
-  //Send I80 Display Command (User defined command of IT8951)
-  this->LCDWriteCmdCode(USDEF_I80_CMD_DPY_AREA); //0x0034
-  //Write arguments
-  this->LCDWriteData(usX);
-  this->LCDWriteData(usY);
-  this->LCDWriteData(usW);
-  this->LCDWriteData(usH);
-  this->LCDWriteData(usDpyMode);
+  //Send I80 Display Command (User defined command of IT8951) and its arguments
+  const uint16_t usArg[5] = {usX, usY, usW, usH, usDpyMode};
+  this->queue_command_(USDEF_I80_CMD_DPY_AREA, usArg, 5); //0x0034
+}
+
+//-----------------------------------------------------------
+//Display functions 4---Display an area from any image buffer
+//-----------------------------------------------------------
+void it8951e::IT8951DisplayAreaBuf(uint16_t usX, uint16_t usY, uint16_t usW, uint16_t usH, uint16_t usDpyMode, uint32_t ulDpyBufAddr)
+{
+  //Send I80 Display Command (User defined command of IT8951) and its arguments
+  const uint16_t usArg[7] = {usX, usY, usW, usH, usDpyMode,
+                             (uint16_t)ulDpyBufAddr,         //Display Buffer Base address[15:0]
+                             (uint16_t)(ulDpyBufAddr>>16)};  //Display Buffer Base address[26:16]
+  this->queue_command_(USDEF_I80_CMD_DPY_BUF_AREA, usArg, 7); //0x0037
 }
 
 
@@ -342,16 +3046,55 @@ void it8951e::IT8951DisplayArea(uint16_t usX, uint16_t usY, uint16_t usW, uint16
 //-----------------------------------------------------------
 void it8951e::LCDWaitForReady()
 {
-  uint8_t ulData = this->busy_pin_->digital_read();
-  const uint32_t start = millis();
-  while(ulData == 0)
+  //HRDY is high most of the time, don't bother with the timer then
+  if (this->busy_pin_->digital_read())
+    return;
+
+  const uint32_t start = micros();
+  this->hrdy_edge_ = false;
+#ifdef USE_ESP32
+  this->hrdy_waiter_ = xTaskGetCurrentTaskHandle();
+#else
+  uint32_t backoff = 1;
+#endif
+  while (!this->hrdy_edge_ && !this->busy_pin_->digital_read())
   {
-    if (millis() - start > this->idle_timeout_()) {
+    const uint32_t elapsed = micros() - start;
+    if (elapsed > (uint32_t) this->idle_timeout_() * 1000u) {
       ESP_LOGE(TAG, "Timeout while displaying image!");
-      return;
+      break;
     }
-    ulData = this->busy_pin_->digital_read();
+    if (elapsed < HRDY_SPIN_US)
+      continue;
+#ifdef USE_ESP32
+    //Sleep until the rising edge interrupt wakes us, the timeout only guards against a missed edge
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(this->busy_backoff_));
+#else
+    delayMicroseconds(backoff);
+    backoff = std::min<uint32_t>(backoff * 2, this->busy_backoff_ * 1000u);
+#endif
+  }
+#ifdef USE_ESP32
+  this->hrdy_waiter_ = nullptr;
+#endif
+
+  const uint32_t waited = micros() - start;
+  this->hrdy_waits_++;
+  this->hrdy_wait_us_ += waited;
+  this->hrdy_wait_max_us_ = std::max(this->hrdy_wait_max_us_, waited);
+}
+
+void IRAM_ATTR it8951e::hrdy_isr_(it8951e *arg)
+{
+  arg->hrdy_edge_ = true;
+#ifdef USE_ESP32
+  TaskHandle_t waiter = arg->hrdy_waiter_;
+  if (waiter != nullptr) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(waiter, &woken);
+    portYIELD_FROM_ISR(woken);
   }
+#endif
 }
 
 //-----------------------------------------------------------
@@ -361,10 +3104,19 @@ void it8951e::LCDWriteCmdCode(uint16_t usCmdCode)
 {
   //Set Preamble for Write Command
   uint16_t wPreamble = 0x6000; 
-  
+
+  //Queued commands go out first
+  this->flush_commands_();
+
+  //Commands other than SYS_RUN need a running controller
+  if (this->controller_state_ != CONTROLLER_RUNNING && usCmdCode != IT8951_TCON_SYS_RUN)
+    this->wake();
+
   this->LCDWaitForReady();  
 
   this->enable();
+  this->stats_.transactions++;
+  this->stats_.bytes_written += 4;
   
   this->write_byte(wPreamble>>8);
   this->write_byte(wPreamble);
@@ -385,9 +3137,14 @@ void it8951e::LCDWriteData(uint16_t usData)
   //Set Preamble for Write Data
   uint16_t wPreamble  = 0x0000;
 
+  //Queued commands go out first
+  this->flush_commands_();
+
   this->LCDWaitForReady();
 
   this->enable();
+  this->stats_.transactions++;
+  this->stats_.bytes_written += 4;
 
   this->write_byte(wPreamble>>8);
   this->write_byte(wPreamble);
@@ -402,25 +3159,93 @@ void it8951e::LCDWriteData(uint16_t usData)
 
 void it8951e::LCDWriteNData(uint16_t* pwBuf, uint32_t ulSizeWordCnt)
 {
-  uint32_t i;
+  this->LCDStartWriteData();
+  this->LCDWriteDataBurst(pwBuf, ulSizeWordCnt);
+  this->LCDEndWriteData();
+}
 
+//-----------------------------------------------------------
+//Host controller function 3a---Burst data write
+//  LCDStartWriteData() asserts CS and sends the data preamble once,
+//  LCDWriteDataBurst() may then be called any number of times to stream
+//  words, LCDEndWriteData() releases CS again.
+//-----------------------------------------------------------
+void it8951e::LCDStartWriteData()
+{
   uint16_t wPreamble  = 0x0000;
 
+  //Queued commands go out first
+  this->flush_commands_();
+
   this->LCDWaitForReady();
 
   this->enable();
-  
+  this->stats_.transactions++;
+  this->stats_.bytes_written += 2;
+
   this->write_byte(wPreamble>>8);
   this->write_byte(wPreamble);
-  
+
   this->LCDWaitForReady();
+}
 
-  for(i=0;i<ulSizeWordCnt;i++)
+void it8951e::LCDWriteDataBurst(const uint16_t* pwBuf, uint32_t ulSizeWordCnt)
+{
+  this->stats_.bytes_written += ulSizeWordCnt * 2;
+  if (this->transfer_buffer_ == nullptr) {
+    this->write_array16(pwBuf, ulSizeWordCnt);
+    return;
+  }
+
+  //Words go out MSB first, swap them into the staging buffer one chunk at a time
+  const uint32_t ulChunkWordCnt = this->transfer_chunk_size_ / 2;
+  while (ulSizeWordCnt > 0)
   {
-    this->write_byte(pwBuf[i]>>8);
-    this->write_byte(pwBuf[i]);
+    uint32_t n = std::min(ulSizeWordCnt, ulChunkWordCnt);
+    uint8_t *pDst = this->transfer_buffer_;
+    for (uint32_t i = 0; i < n; i++)
+    {
+      *pDst++ = pwBuf[i] >> 8;
+      *pDst++ = pwBuf[i];
+    }
+    this->write_array(this->transfer_buffer_, n * 2);
+    pwBuf += n;
+    ulSizeWordCnt -= n;
   }
-  
+}
+
+//-----------------------------------------------------------
+//Host controller function 3b---Burst data write in memory order
+//  Pixels loaded big endian need no swapping and are handed to the SPI
+//  driver straight from where they are, a frame buffer row at a time
+//  or the whole area at once. Only a source the SPI DMA can't read is
+//  copied through the DMA capable transfer buffer.
+//-----------------------------------------------------------
+void it8951e::LCDWriteDataBytes(const uint8_t* pBuf, uint32_t ulSizeByteCnt)
+{
+  this->stats_.bytes_written += ulSizeByteCnt;
+#ifdef USE_ESP32
+  const bool bStaged = this->dma_buffer_ && this->transfer_buffer_ != nullptr && !esp_ptr_dma_capable(pBuf);
+#else
+  const bool bStaged = false;
+#endif
+  if (!bStaged) {
+    this->write_array(pBuf, ulSizeByteCnt);
+    return;
+  }
+
+  while (ulSizeByteCnt > 0)
+  {
+    uint32_t n = std::min(ulSizeByteCnt, this->transfer_chunk_size_);
+    memcpy(this->transfer_buffer_, pBuf, n);
+    this->write_array(this->transfer_buffer_, n);
+    pBuf += n;
+    ulSizeByteCnt -= n;
+  }
+}
+
+void it8951e::LCDEndWriteData()
+{
   this->disable();
 }
 
@@ -434,24 +3259,31 @@ uint16_t it8951e::LCDReadData()
   
   uint16_t wPreamble = 0x1000;
 
+  //Queued commands go out first
+  this->flush_commands_();
+
   this->LCDWaitForReady();
 
-  this->enable();
+  it8951e_spi_t *bus = this->read_device_();
+  bus->enable();
+  this->stats_.transactions++;
+  this->stats_.bytes_written += 2;
+  this->stats_.bytes_read += 4;
     
-  this->write_byte(wPreamble>>8);
-  this->write_byte(wPreamble);
+  bus->write_byte(wPreamble>>8);
+  bus->write_byte(wPreamble);
 
   this->LCDWaitForReady();
   
-  wRData=this->read_byte();
-  wRData=this->read_byte();
+  wRData=bus->read_byte();
+  wRData=bus->read_byte();
   
   this->LCDWaitForReady();
   
-  wRData = this->read_byte()<<8;
-  wRData |= this->read_byte();
+  wRData = bus->read_byte()<<8;
+  wRData |= bus->read_byte();
     
-  this->disable();
+  bus->disable();
     
   return wRData;
 }
@@ -465,42 +3297,105 @@ void it8951e::LCDReadNData(uint16_t* pwBuf, uint32_t ulSizeWordCnt)
   
   uint16_t wPreamble = 0x1000;
 
+  //Queued commands go out first
+  this->flush_commands_();
+
   this->LCDWaitForReady();
 
-  this->enable();
+  it8951e_spi_t *bus = this->read_device_();
+  bus->enable();
+  this->stats_.transactions++;
+  this->stats_.bytes_written += 2;
+  this->stats_.bytes_read += 2 + ulSizeWordCnt * 2;
     
-  this->write_byte(wPreamble>>8);
-  this->write_byte(wPreamble);
+  bus->write_byte(wPreamble>>8);
+  bus->write_byte(wPreamble);
 
   this->LCDWaitForReady();
   
-  pwBuf[0]=this->read_byte();
-  pwBuf[0]=this->read_byte();
+  pwBuf[0]=bus->read_byte();
+  pwBuf[0]=bus->read_byte();
   
   this->LCDWaitForReady();
   
   for(i=0;i<ulSizeWordCnt;i++)
   {
-    pwBuf[i] = this->read_byte()<<8;
-    pwBuf[i] |= this->read_byte();
+    pwBuf[i] = bus->read_byte()<<8;
+    pwBuf[i] |= bus->read_byte();
   }
   
-  this->disable();
+  bus->disable();
 }
 
 //-----------------------------------------------------------
 //Host controller function 5---Write command to host data Bus with aruments
 //-----------------------------------------------------------
-void it8951e::LCDSendCmdArg(uint16_t usCmdCode,uint16_t* pArg, uint16_t usNumArg)
+void it8951e::LCDSendCmdArg(uint16_t usCmdCode,const uint16_t* pArg, uint16_t usNumArg)
 {
      uint16_t i;
      //Send Cmd code
      this->LCDWriteCmdCode(usCmdCode);
-     //Send Data
+     if (usNumArg == 0)
+         return;
+     //All arguments under one data preamble, still waiting for HRDY before every word like LCDReadData() does
+     this->LCDStartWriteData();
      for(i=0;i<usNumArg;i++)
      {
-         this->LCDWriteData(pArg[i]);
+         if (i > 0)
+             this->LCDWaitForReady();
+         this->write_byte(pArg[i]>>8);
+         this->write_byte(pArg[i]);
      }
+     this->stats_.bytes_written += usNumArg * 2;
+     this->LCDEndWriteData();
+}
+
+//-----------------------------------------------------------
+// Command queue
+//  Commands, their arguments and register writes are gathered here and
+//  go out back to back in one flush. Every other transaction flushes the
+//  queue first, so the controller sees the same order as before. A
+//  register written twice while queued is only written once, with the
+//  last value. Each command's arguments share one data preamble and wait
+//  for HRDY word by word, see LCDSendCmdArg().
+//-----------------------------------------------------------
+void it8951e::queue_command_(uint16_t code, const uint16_t *args, uint8_t num_args)
+{
+  if (this->command_count_ == COMMAND_QUEUE_SIZE || this->command_arg_count_ + num_args > COMMAND_QUEUE_ARGS)
+    this->flush_commands_();
+  if (num_args > COMMAND_QUEUE_ARGS) {
+    this->LCDSendCmdArg(code, args, num_args);
+    return;
+  }
+  this->command_queue_[this->command_count_++] = QueuedCommand{code, this->command_arg_count_, num_args};
+  memcpy(this->command_args_ + this->command_arg_count_, args, num_args * sizeof(uint16_t));
+  this->command_arg_count_ += num_args;
+}
+
+void it8951e::queue_register_(uint16_t reg, uint16_t value)
+{
+  //Only the tail of the queue can be replaced, anything queued after the write may depend on it
+  if (this->command_count_ > 0) {
+    const QueuedCommand &last = this->command_queue_[this->command_count_ - 1];
+    if (last.code == IT8951_TCON_REG_WR && this->command_args_[last.first_arg] == reg) {
+      this->command_args_[last.first_arg + 1] = value;
+      return;
+    }
+  }
+  const uint16_t args[2] = {reg, value};
+  this->queue_command_(IT8951_TCON_REG_WR, args, 2);
+}
+
+void it8951e::flush_commands_()
+{
+  //Emptied first, the transactions below would otherwise flush again
+  const uint8_t count = this->command_count_;
+  this->command_count_ = 0;
+  this->command_arg_count_ = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    const QueuedCommand &command = this->command_queue_[i];
+    this->LCDSendCmdArg(command.code, this->command_args_ + command.first_arg, command.num_args);
+  }
 }
 
 
@@ -513,8 +3408,7 @@ uint16_t it8951e::IT8951ReadReg(uint16_t usRegAddr)
   uint16_t usData;
   
   //Send Cmd and Register Address
-  this->LCDWriteCmdCode(IT8951_TCON_REG_RD);
-  this->LCDWriteData(usRegAddr);
+  this->LCDSendCmdArg(IT8951_TCON_REG_RD, &usRegAddr, 1);
   //Read data from Host Data bus
   usData = LCDReadData();
   return usData;
@@ -524,10 +3418,8 @@ uint16_t it8951e::IT8951ReadReg(uint16_t usRegAddr)
 //-----------------------------------------------------------
 void it8951e::IT8951WriteReg(uint16_t usRegAddr,uint16_t usValue)
 {
-  //Send Cmd , Register Address and Write Value
-  this->LCDWriteCmdCode(IT8951_TCON_REG_WR);
-  this->LCDWriteData(usRegAddr);
-  this->LCDWriteData(usValue);
+  //Queue Cmd , Register Address and Write Value
+  this->queue_register_(usRegAddr, usValue);
 }
 
 }  // namespace it8951e
@@ -3,6 +3,27 @@
 #include "esphome/core/component.h"
 #include "esphome/components/spi/spi.h"
 #include "esphome/components/display/display_buffer.h"
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+#ifdef USE_IT8951E_INK
+#include "esphome/components/gt911/gt911.h"
+#endif
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef USE_ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
 
 namespace esphome {
 namespace it8951e {
@@ -30,29 +51,358 @@ typedef struct IT8951LdImgInfo
     uint16_t usEndianType; //little or Big Endian
     uint16_t usPixelFormat; //bpp
     uint16_t usRotate; //Rotate mode
-    uint32_t ulStartFBAddr; //Start address of source Frame buffer
+    uintptr_t ulStartFBAddr; //Start address of source Frame buffer
     uint32_t ulImgBufBaseAddr;//Base address of target image buffer
     
 }IT8951LdImgInfo;
 
+/// Inclusive pixel bounds of a region that changed since the last display().
+struct DirtyArea {
+  int16_t x0;
+  int16_t y0;
+  int16_t x1;
+  int16_t y1;
+};
+
+/// Image kept in off-screen controller memory, see it8951e::cache_region().
+struct CachedImage {
+  std::string name;
+  /// Word aligned slot in the cache page.
+  uint16_t slot_x;
+  uint16_t slot_width;
+  /// Position of the first image pixel in the cache page.
+  uint16_t cache_x;
+  uint16_t cache_y;
+  uint16_t width;
+  uint16_t height;
+  /// Only black and white pixels, shown with DU.
+  bool binary;
+};
+
+/// Dithering applied when converting colors and images to the panel's gray levels.
+enum DitherMode : uint8_t {
+  DITHER_NONE = 0,
+  DITHER_BAYER,
+  DITHER_FLOYD_STEINBERG,
+};
 
-class it8951e : public PollingComponent,
-                        public display::DisplayBuffer,
-                        public spi::SPIDevice<spi::BIT_ORDER_MSB_FIRST, spi::CLOCK_POLARITY_LOW,
-                                              spi::CLOCK_PHASE_LEADING, spi::DATA_RATE_2MHZ> {
+/// Part of the screen with its own refresh rate limit, see it8951e::schedule_areas_().
+struct UpdateRegion {
+  DirtyArea area;
+  uint32_t min_interval;
+  /// Sent ahead of regions without priority.
+  bool priority;
+  bool refreshed;
+  uint32_t last_refresh;
+};
+
+/// Panel area a display command is refreshing and the LUT engines it was given.
+struct InflightArea {
+  DirtyArea area;
+  uint16_t engines;
+};
+
+/// 4bpp image stored RLE compressed in flash, generated from the assets option.
+class IT8951Asset {
  public:
+  IT8951Asset(const uint8_t *data, size_t length, uint16_t width, uint16_t height)
+      : data_(data), length_(length), width_(width), height_(height) {}
+
+  const uint8_t *get_data() const { return this->data_; }
+  size_t get_length() const { return this->length_; }
+  uint16_t get_width() const { return this->width_; }
+  uint16_t get_height() const { return this->height_; }
+  /// Rows are padded to whole words, 4 pixels at 4bpp.
+  uint16_t get_load_width() const { return (this->width_ + 3) & ~3; }
+
+ protected:
+  const uint8_t *data_;
+  size_t length_;
+  uint16_t width_;
+  uint16_t height_;
+};
+
+/// How a tile of the compressed frame is stored, see it8951e::store_tile_().
+enum TileKind : uint8_t {
+  /// Never stored or didn't fit the pool, reads as background and always counts as changed.
+  TILE_UNKNOWN = 0,
+  /// Every byte is value.
+  TILE_UNIFORM,
+  /// length bytes in the same RLE format as flash assets.
+  TILE_RLE,
+  /// length bytes verbatim, when RLE doesn't make the tile smaller.
+  TILE_RAW,
+};
+
+/// One TILE_SIZE x TILE_SIZE tile of the compressed frame.
+struct FrameTile {
+  TileKind kind;
+  uint8_t value;
+  uint16_t length;
+  /// First pool block of RLE and raw tiles.
+  uint16_t block;
+};
+
+/// Fixed size blocks for compressed tiles, allocated once. A tile's blocks are chained and freed together.
+class TilePool {
+ public:
+  bool init(uint32_t size);
+  /// Returns the first block, or TILE_BLOCK_NONE when the pool is too full for length bytes.
+  uint16_t store(const uint8_t *data, uint16_t length);
+  void release(uint16_t block);
+  void read(uint16_t block, uint8_t *out, uint16_t length) const;
+  bool equals(uint16_t block, const uint8_t *data, uint16_t length) const;
+  uint16_t get_block_count() const { return this->block_count_; }
+  uint16_t get_free_count() const { return this->free_count_; }
+
+ protected:
+  uint8_t *data_{nullptr};
+  std::vector<uint16_t> next_;
+  uint16_t free_;
+  uint16_t block_count_{0};
+  uint16_t free_count_{0};
+};
+
+/// Power state the controller was last put in.
+enum ControllerState : uint8_t {
+  CONTROLLER_RUNNING = 0,
+  CONTROLLER_STANDBY,
+  CONTROLLER_SLEEP,
+};
+
+/// Command waiting in the command queue, its arguments are in command_args_.
+struct QueuedCommand {
+  uint16_t code;
+  uint8_t first_arg;
+  uint8_t num_args;
+};
+
+/// Traffic on the host interface, counted by the LCD* bus functions.
+struct ProtocolStats {
+  uint32_t transactions;
+  uint32_t bytes_written;
+  uint32_t bytes_read;
+};
+
+/// Cost of one frame update, times in microseconds.
+struct UpdateTimings {
+  uint32_t render_us;
+  uint32_t pack_us;
+  uint32_t transfer_us;
+  uint32_t bytes;
+  uint32_t busy_us;
+};
+
+/// Minimum, maximum and running mean of one timing since boot.
+struct TimingSummary {
+  uint32_t min{UINT32_MAX};
+  uint32_t max{0};
+  uint64_t sum{0};
+  uint32_t count{0};
+
+  void add(uint32_t value);
+};
+
+/// Identifies a rasterized glyph: font, character and the gray levels it was drawn with.
+struct GlyphKey {
+  const display::BaseFont *font;
+  uint32_t codepoint;
+  uint8_t fg;
+  uint8_t bg;
+
+  bool operator<(const GlyphKey &other) const {
+    if (this->font != other.font)
+      return this->font < other.font;
+    if (this->codepoint != other.codepoint)
+      return this->codepoint < other.codepoint;
+    if (this->fg != other.fg)
+      return this->fg < other.fg;
+    return this->bg < other.bg;
+  }
+};
+
+/// Glyph cell packed at the frame's bits per pixel, opaque over its background.
+struct CachedGlyph {
+  GlyphKey key;
+  /// Left edge of the cell relative to the pen position.
+  int16_t x_offset;
+  uint16_t advance;
+  uint16_t width;
+  uint16_t height;
+  uint16_t row_bytes;
+  std::vector<uint8_t> data;
+};
+
+/// Cached image queued for display with DPY_BUF_AREA.
+struct CachedBlit {
+  uint16_t index;
+  uint16_t x;
+  uint16_t y;
+  /// Shown again by the writer since the last update started.
+  bool wanted;
+  /// Not on the panel as cached, because it is new or a refresh covered it.
+  bool stale;
+};
+
+/// Flash asset the writer placed, streamed straight into image memory, see it8951e::draw_asset().
+struct PlacedAsset {
+  const IT8951Asset *asset;
+  uint16_t x;
+  uint16_t y;
+  /// Load width, the asset's rows padded to the word alignment of the frame.
+  uint16_t width;
+  /// Drawn again by the writer since the last update started.
+  bool wanted;
+  /// Not in image memory yet, because it is new or another asset was streamed over it.
+  bool stale;
+  /// Only black and white, known once it was streamed.
+  bool binary;
+};
+
+/// Waveform used for regions that only contain black and white pixels.
+enum BinaryWaveform : uint8_t {
+  BINARY_WAVEFORM_GC16 = 0,
+  BINARY_WAVEFORM_DU,
+  BINARY_WAVEFORM_A2,
+};
+
+/// Number of disjoint dirty areas tracked before areas get merged.
+static const uint8_t MAX_DIRTY_AREAS = 8;
+/// Areas closer than this many pixels are merged instead of tracked separately.
+static const int16_t DIRTY_MERGE_DISTANCE = 32;
+/// Granularity of the per tile bookkeeping: grayscale history and frame diff hashes.
+static const uint16_t TILE_SIZE = 32;
+/// Words written to and read back from controller memory by the SPI self-test.
+static const uint32_t SPI_SELF_TEST_WORDS = 64;
+/// Size of the image cache in controller memory, in full panel frames at 8bpp.
+static const uint16_t IMAGE_CACHE_FRAMES = 2;
+/// Regions that can be configured next to the rest of the screen.
+static const uint8_t MAX_UPDATE_REGIONS = 4;
+/// Areas one update can send, every region merges its share down to MAX_DIRTY_AREAS.
+static const uint8_t MAX_SCHEDULED_AREAS = MAX_DIRTY_AREAS * (MAX_UPDATE_REGIONS + 1);
+/// Display commands tracked at once, more wait for all engines to finish.
+static const uint8_t MAX_INFLIGHT_AREAS = 16;
+/// Size of the blocks compressed tiles are stored in.
+static const uint16_t TILE_BLOCK_SIZE = 32;
+static const uint16_t TILE_BLOCK_NONE = 0xFFFF;
+/// Commands and argument words the command queue holds before it has to flush.
+static const uint8_t COMMAND_QUEUE_SIZE = 8;
+static const uint8_t COMMAND_QUEUE_ARGS = 32;
+/// Touch ids the ink path keeps strokes apart for.
+static const uint8_t INK_TOUCH_IDS = 16;
+/// HRDY is usually back within microseconds, spin this long before sleeping on the interrupt.
+static const uint32_t HRDY_SPIN_US = 20;
+
+class it8951e;
+
+using it8951e_writer_t = std::function<void(it8951e &)>;
+/// The display's SPI device, reads at their own clock go through a second one of the same type.
+using it8951e_spi_t = spi::SPIDevice<spi::BIT_ORDER_MSB_FIRST, spi::CLOCK_POLARITY_LOW, spi::CLOCK_PHASE_LEADING,
+                                     spi::DATA_RATE_2MHZ>;
+
+class it8951e : public PollingComponent, public display::DisplayBuffer, public it8951e_spi_t {
+ public:
+  /// Stops the pipeline task, after the frame it is sending.
+  ~it8951e();
+
   float get_setup_priority() const override;
   void set_reset_pin(GPIOPin *reset) { this->reset_pin_ = reset; }
-  void set_busy_pin(GPIOPin *busy) { this->busy_pin_ = busy; }
+  void set_busy_pin(InternalGPIOPin *busy) { this->busy_pin_ = busy; }
   void set_en_pin(GPIOPin *en) { this->en_pin_ = en; }
+  void set_transfer_chunk_size(uint32_t transfer_chunk_size) { this->transfer_chunk_size_ = transfer_chunk_size; }
+  void set_dma_buffer(bool dma_buffer) { this->dma_buffer_ = dma_buffer; }
+  void set_full_update_every(uint32_t full_update_every) { this->full_update_every_ = full_update_every; }
+  void set_cleanup_threshold(uint8_t cleanup_threshold) { this->cleanup_threshold_ = cleanup_threshold; }
+  void set_cleanup_delay(uint32_t cleanup_delay) { this->cleanup_delay_ = cleanup_delay; }
+  void set_binary_waveform(BinaryWaveform binary_waveform) { this->binary_waveform_ = binary_waveform; }
+  void set_bits_per_pixel(uint8_t bits_per_pixel) { this->bits_per_pixel_ = bits_per_pixel; }
+  void set_double_buffer(bool double_buffer) { this->double_buffer_ = double_buffer; }
+  void set_busy_backoff(uint32_t busy_backoff) { this->busy_backoff_ = busy_backoff; }
+  void set_frame_diff(bool frame_diff) { this->frame_diff_ = frame_diff; }
+  void set_band_height(uint16_t band_height) { this->band_height_ = band_height; }
+  void set_glyph_cache_size(uint32_t glyph_cache_size) { this->glyph_cache_size_ = glyph_cache_size; }
+  void set_dither(DitherMode dither) { this->dither_ = dither; }
+  void set_idle_standby(bool idle_standby) { this->idle_standby_ = idle_standby; }
+  void set_tile_pool_size(uint32_t tile_pool_size) { this->tile_pool_size_ = tile_pool_size; }
+  void set_update_window(uint32_t update_window) { this->update_window_ = update_window; }
+  void set_min_refresh_interval(uint32_t min_refresh_interval) {
+    this->background_region_.min_interval = min_refresh_interval;
+  }
+  /// Give part of the screen its own minimum refresh interval, priority regions are sent first.
+  void add_region(int16_t x, int16_t y, int16_t width, int16_t height, uint32_t min_interval, bool priority);
+#ifdef USE_SENSOR
+  void set_render_time_sensor(sensor::Sensor *sensor) { this->render_time_sensor_ = sensor; }
+  void set_pack_time_sensor(sensor::Sensor *sensor) { this->pack_time_sensor_ = sensor; }
+  void set_transfer_time_sensor(sensor::Sensor *sensor) { this->transfer_time_sensor_ = sensor; }
+  void set_bytes_sent_sensor(sensor::Sensor *sensor) { this->bytes_sent_sensor_ = sensor; }
+  void set_busy_wait_time_sensor(sensor::Sensor *sensor) { this->busy_wait_time_sensor_ = sensor; }
+  void set_lut_time_sensor(sensor::Sensor *sensor) { this->lut_time_sensor_ = sensor; }
+#endif
+#ifdef USE_IT8951E_INK
+  /// Draw what is written on this touchscreen straight into the frame and refresh it with A2 right away.
+  void set_ink_touchscreen(gt911::GT911 *touchscreen);
+  void set_ink_pen_size(uint8_t ink_pen_size) { this->ink_pen_size_ = ink_pen_size; }
+#endif
+  void set_read_data_rate(uint32_t read_data_rate) { this->read_data_rate_ = read_data_rate; }
+  void set_spi_self_test(bool spi_self_test) { this->spi_self_test_ = spi_self_test; }
 
   void display();
   void initialize();
+  /// Time register accesses, a full and a partial update on the panel and log the results.
+  void benchmark();
+
+  /// Upload a region of the frame buffer into controller memory under the given name.
+  bool cache_region(const std::string &name, int x, int y, int width, int height);
+  /// Show a cached image at (x, y) on top of the frame, without sending its pixels again.
+  /// Like drawing, call it on every update the image should stay up. It is only refreshed when it
+  /// is new or another refresh covered it; once the writer stops showing it, its area is redrawn.
+  bool show_cached(const std::string &name, int x, int y);
+  bool is_cached(const std::string &name);
+  void clear_image_cache();
+
+  /// Stream a flash asset into image memory at (x, y), on top of the frame. The frame buffer isn't
+  /// touched and frame uploads leave the asset's area alone. Like show_cached() it is only sent when
+  /// new; once the writer stops drawing it, its area is redrawn. Needs 2, 4 or 8 bits per pixel, no
+  /// double buffering, the asset fully on screen and x a multiple of 4 (8 at 2bpp).
+  bool draw_asset(int x, int y, const IT8951Asset *asset);
+
+  /// Draw rows of 8 bit luminance (0 is black), converted and dithered a row at a time.
+  void draw_gray_image(int x, int y, int width, int height, const uint8_t *data);
+  /// Same for rows of RGB888 pixels.
+  void draw_rgb_image(int x, int y, int width, int height, const uint8_t *data);
+
+  /// Print text on an opaque background through the glyph cache.
+  void print_cached(int x, int y, display::BaseFont *font, Color color, Color background, display::TextAlign align,
+                    const char *text);
+  void print_cached(int x, int y, display::BaseFont *font, Color color, Color background, const char *text) {
+    this->print_cached(x, y, font, color, background, display::TextAlign::TOP_LEFT, text);
+  }
+  /// Put the controller to sleep and remember its state for a fast wake after the ESP deep sleeps.
   void deep_sleep();
+  /// Stop the controller clocks until the next command.
+  void standby();
+  void wake();
+
+  void enablePower();
+  void disablePower();
 
+  /// Draws the next frame, after the update window when one is configured.
   void update() override;
+  void loop() override;
+  void dump_config() override;
+
+  void set_writer(it8951e_writer_t &&writer) {
+    this->DisplayBuffer::set_writer([this, writer](display::DisplayBuffer &) { writer(*this); });
+  }
 
   void fill(Color color) override;
+  // Word wide versions of the DisplayBuffer primitives. They hide the non-virtual base ones, so only code
+  // calling them on an it8951e & (the writer lambda) gets them; pages: and ESPHome widgets that draw
+  // through a DisplayBuffer & or Display & end up in draw_absolute_pixel_internal() pixel by pixel.
+  void horizontal_line(int x, int y, int width, Color color = display::COLOR_ON);
+  void vertical_line(int x, int y, int height, Color color = display::COLOR_ON);
+  void rectangle(int x1, int y1, int width, int height, Color color = display::COLOR_ON);
+  void filled_rectangle(int x1, int y1, int width, int height, Color color = display::COLOR_ON);
 
   void setup() override {
     this->setup_pins_();
@@ -61,14 +411,69 @@ class it8951e : public PollingComponent,
 
   void on_safe_shutdown() override;
 
+  display::DisplayType get_display_type() override {
+    return this->bits_per_pixel_ == 1 ? display::DisplayType::DISPLAY_TYPE_BINARY
+                                      : display::DisplayType::DISPLAY_TYPE_GRAYSCALE;
+  }
+
  protected:
   void draw_absolute_pixel_internal(int x, int y, Color color) override;
 
+  int get_width_internal() override { return this->width_; }
+  int get_height_internal() override { return this->height_; }
+
+  // IT8951 host interface, named after the ITE sample code
+  void GetIT8951SystemInfo();
+  void IT8951LoadImgStart(IT8951LdImgInfo* pstLdImgInfo);
+  void IT8951LoadImgAreaStart(IT8951LdImgInfo* pstLdImgInfo, IT8951AreaImgInfo* pstAreaImgInfo);
+  void IT8951LoadImgEnd(void);
+  void IT8951SetImgBufBaseAddr(uint32_t ulImgBufAddr);
+  void IT8951WaitForDisplayReady();
+  void IT8951HostAreaPackedPixelWrite(IT8951LdImgInfo* pstLdImgInfo, IT8951AreaImgInfo* pstAreaImgInfo);
+  void IT8951DisplayArea(uint16_t usX, uint16_t usY, uint16_t usW, uint16_t usH, uint16_t usDpyMode);
+  void IT8951DisplayAreaBuf(uint16_t usX, uint16_t usY, uint16_t usW, uint16_t usH, uint16_t usDpyMode, uint32_t ulDpyBufAddr);
+  void IT8951MemBurstReadTrigger(uint32_t ulMemAddr, uint32_t ulReadSize);
+  void IT8951MemBurstReadStart();
+  void IT8951MemBurstWrite(uint32_t ulMemAddr, uint32_t ulWriteSize);
+  void IT8951MemBurstEnd(void);
+  void IT8951MemBurstWriteProc(uint32_t ulMemAddr, uint32_t ulWriteSize, uint16_t* pSrcBuf);
+  void IT8951MemBurstReadProc(uint32_t ulMemAddr, uint32_t ulReadSize, uint16_t* pBuf);
+  uint16_t IT8951ReadReg(uint16_t usRegAddr);
+  void IT8951WriteReg(uint16_t usRegAddr, uint16_t usValue);
+
+  void poll_display_ready_();
+  DirtyArea to_load_area_(const DirtyArea &area);
+  bool overlaps_inflight_(const DirtyArea &panel_area);
+  void retire_inflight_(uint16_t engines_busy);
+  void track_refresh_(const DirtyArea &panel_area);
+  void wait_for_area_(const DirtyArea &panel_area);
+
+  void LCDWaitForReady();
+  static void hrdy_isr_(it8951e *arg);
+  void LCDWriteCmdCode(uint16_t usCmdCode);
+  void LCDWriteData(uint16_t usData);
+  void LCDWriteNData(uint16_t* pwBuf, uint32_t ulSizeWordCnt);
+  void LCDStartWriteData();
+  void LCDWriteDataBurst(const uint16_t* pwBuf, uint32_t ulSizeWordCnt);
+  void LCDWriteDataBytes(const uint8_t* pBuf, uint32_t ulSizeByteCnt);
+  void LCDEndWriteData();
+  uint16_t LCDReadData();
+  void LCDReadNData(uint16_t* pwBuf, uint32_t ulSizeWordCnt);
+  void LCDSendCmdArg(uint16_t usCmdCode, const uint16_t* pArg, uint16_t usNumArg);
+
+  void queue_command_(uint16_t code, const uint16_t *args, uint8_t num_args);
+  void queue_register_(uint16_t reg, uint16_t value);
+  void flush_commands_();
+
   bool wait_until_idle_();
 
   void setup_pins_();
+  bool restore_from_sleep_();
+  void store_for_sleep_();
 
   void reset_() {
+    //A reset controller starts over with its own register values
+    this->lisar_ = UINT32_MAX;
     if (this->reset_pin_ != nullptr) {
       this->reset_pin_->digital_write(false);
       delay(500);  // NOLINT
@@ -78,16 +483,282 @@ class it8951e : public PollingComponent,
   }
 
   uint32_t get_buffer_length_();
+  void render_update_();
+  void update_banded_();
+
+  UpdateRegion &get_region_(uint8_t id) { return id == 0 ? this->background_region_ : this->regions_[id - 1]; }
+  void mark_region_tiles_(const DirtyArea &area, uint8_t id);
+  void forget_tiles_(const DirtyArea &area);
+  uint32_t region_wait_(const UpdateRegion &region, uint32_t now);
+  uint8_t schedule_areas_(DirtyArea *out, uint8_t &priority);
+
+  void get_tile_span_(uint16_t tx, uint16_t ty, uint32_t &x0, uint32_t &row_bytes, uint16_t &y0, uint16_t &rows);
+  uint16_t gather_tile_(uint16_t tx, uint16_t ty);
+  void scatter_tile_(uint16_t tx, uint16_t ty);
+  bool store_tile_(uint32_t index, uint16_t length);
+  void load_tile_(uint32_t index, uint16_t length);
+  void decode_band_(int y, uint16_t rows);
+  bool diff_tile_(uint32_t index, uint16_t tx, uint16_t ty);
+  bool store_band_(int y, uint16_t rows, bool drawn);
+  void mark_changed_tiles_();
+  void benchmark_tiles_();
+
+  void publish_timings_();
+  void publish_lut_time_();
+
+  uint32_t modeled_wire_us_(const ProtocolStats &stats);
+  void benchmark_step_(const char *name, const std::function<void()> &step);
+
+  uint32_t get_cache_addr_();
+  bool check_image_cache_();
+  CachedImage *find_cached_(const std::string &name);
+  void flush_direct_updates_(bool cleanup = false);
+  void settle_blits_();
+  void drop_blit_(const CachedBlit &blit);
+  void cover_blits_(const DirtyArea &panel_area);
+  void mark_gray_tiles_(const DirtyArea &area);
+  void stream_asset_(PlacedAsset &placed);
+  bool over_gray_asset_(const DirtyArea &area);
+
+  void capture_pixel_(int x, int y, Color color);
+  void rasterize_glyph_(CachedGlyph &glyph, display::BaseFont *font, Color color, const char *utf8);
+  const CachedGlyph &get_glyph_(display::BaseFont *font, Color color, Color background, uint32_t codepoint,
+                                const char *utf8);
+  void blit_packed_row_(uint8_t *row, int x, const uint8_t *src, int width);
+  void blit_glyph_(const CachedGlyph &glyph, int x, int y);
+  uint32_t get_scratch_addr_();
+
+  void apply_spi_rates_();
+  it8951e_spi_t *read_device_() { return this->reader_rate_ != 0 ? &this->reader_ : this; }
+  bool check_spi_readback_();
+  void run_spi_self_test_();
+
+  void mark_dirty_(int x0, int y0, int x1, int y1);
+  void coalesce_dirty_();
+  bool overlaps_dirty_(const DirtyArea &area);
+  uint32_t hash_tile_(const uint8_t *frame, uint16_t tx, uint16_t ty);
+  void diff_dirty_(const uint8_t *frame);
+  void build_gray_luts_();
+  uint8_t get_intensity_(Color color);
+  uint8_t get_pixel_value_(Color color);
+  uint8_t get_dithered_value_(uint8_t intensity, int x, int y);
+  void draw_image_rows_(int x, int y, int width, int height, const uint8_t *data, uint8_t bytes_per_pixel);
+  uint8_t replicate_value_(uint8_t value);
+  void set_pixel_value_(uint8_t *row, int x, uint8_t value);
+  bool clip_fast_(int &x, int &y, int &width, int &height);
+  void fill_span_(uint8_t *row, int x0, int x1, uint8_t value);
+  IT8951AreaImgInfo align_area_(const DirtyArea &area);
+  DirtyArea to_panel_area_(const DirtyArea &area);
+  void upload_area_(const uint8_t *frame, const DirtyArea &area, uint32_t image_addr);
+  void upload_frame_(const uint8_t *frame, const DirtyArea &area, size_t first = 0);
+  void display_frame_(const uint8_t *frame, const DirtyArea *areas, uint8_t count, uint8_t priority = 0);
+  bool full_update_due_();
+  void refresh_area_(const uint8_t *frame, const DirtyArea &area);
+  void refresh_areas_(const uint8_t *frame, const DirtyArea *areas, uint8_t count, uint8_t refreshed = 0);
+  bool is_binary_area_(const uint8_t *frame, const DirtyArea &area);
+  void count_ghosting_(const DirtyArea &area, bool cleared);
+  bool cleanup_ghosting_();
+#ifdef USE_IT8951E_INK
+  void ink_to_frame_(int &x, int &y);
+  void ink_touches_(const gt911::TP_Point *points, uint8_t count);
+  void ink_dot_(int x, int y);
+  void flush_ink_();
+#endif
+  uint16_t select_waveform_(const uint8_t *frame, const DirtyArea &area);
+
+  bool start_pipeline_();
+  static void pipeline_task_(void *arg);
+  void stop_pipeline_();
+  void swap_buffers_();
 
   GPIOPin *reset_pin_{nullptr};
   GPIOPin *cs_pin_;
-  GPIOPin *busy_pin_{nullptr};
+  InternalGPIOPin *busy_pin_{nullptr};
   GPIOPin *en_pin_{nullptr};
   virtual int idle_timeout_() { return 1000; }  // NOLINT(readability-identifier-naming)
 
-  IT8951DevInfo gstI80DevInfo;
+  IT8951DevInfo gstI80DevInfo{};
+  /// Host frame buffer format: 1, 2, 4 or 8 bits per pixel, rows padded to whole words.
+  uint8_t bits_per_pixel_{4};
+  uint32_t pitch_{0};
+  /// Host frame buffer size, the panel size with width and height swapped for 90/270 degree rotation.
+  uint16_t width_{0};
+  uint16_t height_{0};
+  /// Rotate argument of LD_IMG_AREA, replaces DisplayBuffer's per pixel rotation.
+  uint16_t hw_rotate_{0};
   uint8_t* gpFrameBuf;
   uint32_t gulImgBufAddr;
+
+  /// Staging buffer for byte swapped word writes and for pixels the SPI DMA can't read, transfer_chunk_size_ bytes long.
+  uint8_t *transfer_buffer_{nullptr};
+  uint32_t transfer_chunk_size_{4096};
+  bool dma_buffer_{false};
+
+  ProtocolStats stats_{};
+
+  /// Commands not sent yet, flushed before any other transaction so the order on the bus is kept.
+  QueuedCommand command_queue_[COMMAND_QUEUE_SIZE];
+  uint16_t command_args_[COMMAND_QUEUE_ARGS];
+  uint8_t command_count_{0};
+  uint8_t command_arg_count_{0};
+  /// Image buffer address last written to LISAR, UINT32_MAX when unknown.
+  uint32_t lisar_{UINT32_MAX};
+
+  /// The controller starts out asleep until proven otherwise, see initialize().
+  ControllerState controller_state_{CONTROLLER_SLEEP};
+  bool idle_standby_{false};
+
+  /// Render and pack times of the frame being drawn, and the complete timings of the frame last sent.
+  UpdateTimings render_timings_{};
+  UpdateTimings frame_timings_{};
+  std::atomic<bool> timings_ready_{false};
+  std::atomic<bool> lut_ready_{false};
+  TimingSummary render_summary_;
+  TimingSummary pack_summary_;
+  TimingSummary transfer_summary_;
+  TimingSummary bytes_summary_;
+  TimingSummary busy_summary_;
+  TimingSummary lut_summary_;
+#ifdef USE_SENSOR
+  sensor::Sensor *render_time_sensor_{nullptr};
+  sensor::Sensor *pack_time_sensor_{nullptr};
+  sensor::Sensor *transfer_time_sensor_{nullptr};
+  sensor::Sensor *bytes_sent_sensor_{nullptr};
+  sensor::Sensor *busy_wait_time_sensor_{nullptr};
+  sensor::Sensor *lut_time_sensor_{nullptr};
+#endif
+
+  /// SPI clock for writes (taken from data_rate) and for reads, 0 reads at the write clock.
+  uint32_t write_data_rate_{0};
+  uint32_t read_data_rate_{0};
+  /// Same bus and CS pin as this device, registered at read_data_rate when that differs from the write clock.
+  it8951e_spi_t reader_;
+  /// Clock reader_ is registered with, 0 while reads share this device.
+  uint32_t reader_rate_{0};
+  bool spi_self_test_{true};
+
+  DirtyArea dirty_areas_[MAX_DIRTY_AREAS];
+  uint8_t dirty_count_{0};
+  /// Index of the area that absorbed the last pixel, checked first on the next one.
+  uint8_t dirty_last_{0};
+
+  uint32_t full_update_every_{30};
+  std::atomic<uint32_t> partial_updates_{0};
+  bool force_full_update_{false};
+  BinaryWaveform binary_waveform_{BINARY_WAVEFORM_DU};
+  /// Waveform index of A2, depends on the LUT loaded in the controller.
+  uint16_t a2_mode_{6};
+  uint16_t tiles_x_{0};
+  uint16_t tiles_y_{0};
+  std::vector<bool> gray_tiles_;
+
+  /// Non GC16 refreshes of every tile since its last GC16. Tiles past cleanup_threshold_
+  /// get a GC16 of their own once nothing was refreshed for cleanup_delay_ ms.
+  std::vector<uint8_t> ghost_counts_;
+  uint8_t cleanup_threshold_{0};
+  uint32_t cleanup_delay_{5000};
+  std::atomic<bool> cleanup_pending_{false};
+  std::atomic<uint32_t> last_refresh_ms_{0};
+
+#ifdef USE_IT8951E_INK
+  gt911::GT911 *ink_touchscreen_{nullptr};
+  uint8_t ink_pen_size_{3};
+  /// Bounds of the strokes drawn since the last ink refresh.
+  bool ink_pending_{false};
+  DirtyArea ink_area_{};
+  /// Last point of every touch id, a stroke is drawn as lines between them.
+  bool ink_down_[INK_TOUCH_IDS]{};
+  int16_t ink_last_x_[INK_TOUCH_IDS];
+  int16_t ink_last_y_[INK_TOUCH_IDS];
+#endif
+
+  /// Hash of every tile as last sent to the controller, 0 means unknown.
+  bool frame_diff_{true};
+  std::vector<uint32_t> tile_hashes_;
+  std::vector<bool> changed_tiles_;
+
+  /// update() calls within this many ms of the first one are drawn as one frame.
+  uint32_t update_window_{0};
+  bool update_requested_{false};
+  uint32_t update_due_{0};
+  /// Region 0 is everything no configured region covers, tile_regions_ maps tiles to region ids.
+  UpdateRegion background_region_{};
+  std::vector<UpdateRegion> regions_;
+  std::vector<uint8_t> tile_regions_;
+  /// When loop() tries the dirty areas display() had to hold back again.
+  uint32_t schedule_retry_{0};
+
+  /// Rows of the panel held in buffer_, all of them unless rendering in bands.
+  uint16_t band_height_{0};
+  int16_t frame_y0_{0};
+  uint16_t frame_rows_{0};
+  bool band_binary_{false};
+
+  /// Compressed copy of the whole frame kept next to the band, empty unless tile_pool_size_ is set.
+  uint32_t tile_pool_size_{0};
+  TilePool tile_pool_;
+  std::vector<FrameTile> frame_tiles_;
+  /// One tile unpacked and one encoded, TILE_SIZE * TILE_SIZE pixels each.
+  std::vector<uint8_t> tile_raw_;
+  std::vector<uint8_t> tile_packed_;
+
+  std::vector<CachedImage> image_cache_;
+  std::vector<CachedBlit> cached_blits_;
+  std::vector<PlacedAsset> placed_assets_;
+  uint16_t cache_shelf_x_{0};
+  uint16_t cache_shelf_y_{0};
+  uint16_t cache_shelf_h_{0};
+
+  DitherMode dither_{DITHER_NONE};
+  /// Ink intensity to nearest ink level, and to level * 16 for ordered dithering.
+  uint8_t level_lut_[256];
+  uint16_t dither_lut_[256];
+  /// Ink level to the pixel value stored in the frame.
+  uint8_t level_value_[16];
+  uint8_t max_level_{15};
+  std::vector<uint8_t> row_scratch_;
+  std::vector<int16_t> dither_errors_;
+
+  /// Most recently used glyph first, glyph_cache_used_ counts their bytes.
+  uint32_t glyph_cache_size_{8192};
+  uint32_t glyph_cache_used_{0};
+  std::list<CachedGlyph> glyphs_;
+  std::map<GlyphKey, std::list<CachedGlyph>::iterator> glyph_index_;
+  CachedGlyph glyph_scratch_;
+  /// Glyph being rasterized, pixels are redirected into it instead of the frame.
+  CachedGlyph *capture_{nullptr};
+
+  bool double_buffer_{false};
+  /// Frame owned by the pipeline task while pipeline_busy_ is set.
+  uint8_t *front_buffer_{nullptr};
+  DirtyArea front_areas_[MAX_DIRTY_AREAS];
+  uint8_t front_count_{0};
+  std::atomic<bool> pipeline_busy_{false};
+  bool frame_pending_{false};
+
+  /// Upper bound in ms for the exponential backoff between HRDY and LUTAFSR polls.
+  uint32_t busy_backoff_{8};
+  volatile bool hrdy_edge_{false};
+  uint32_t hrdy_waits_{0};
+  uint32_t hrdy_wait_us_{0};
+  uint32_t hrdy_wait_max_us_{0};
+  /// LUT engines are refreshing, LUTAFSR is polled from loop() (or the pipeline task)
+  std::atomic<bool> lut_busy_{false};
+  uint32_t lut_start_{0};
+  uint32_t lut_next_poll_{0};
+  uint32_t lut_backoff_{1};
+  uint32_t lut_wait_ms_{0};
+  InflightArea inflight_[MAX_INFLIGHT_AREAS];
+  uint8_t inflight_count_{0};
+#ifdef USE_ESP32
+  TaskHandle_t pipeline_task_handle_{nullptr};
+  TaskHandle_t volatile hrdy_waiter_{nullptr};
+#else
+  std::thread pipeline_thread_;
+  std::atomic<bool> pipeline_stop_{false};
+  std::mutex pipeline_mutex_;
+  std::condition_variable pipeline_cv_;
+#endif
 };
 
 }  // namespace it8951e
@@ -3,20 +3,197 @@ import esphome.config_validation as cv
 from esphome import pins
 from esphome.components import display, spi
 from esphome.const import (
+    CONF_AUTO_CLEAR_ENABLED,
     CONF_BUSY_PIN,
+    CONF_DATA_RATE,
+    CONF_FILE,
     CONF_FULL_UPDATE_EVERY,
+    CONF_HEIGHT,
     CONF_ID,
     CONF_LAMBDA,
     CONF_PAGES,
+    CONF_RAW_DATA_ID,
     CONF_RESET_PIN,
+    CONF_RESIZE,
+    CONF_WIDTH,
 )
+from esphome.core import CORE
 
 DEPENDENCIES = ["spi"]
 
+CONF_TRANSFER_CHUNK_SIZE = "transfer_chunk_size"
+CONF_DMA_BUFFER = "dma_buffer"
+CONF_BINARY_WAVEFORM = "binary_waveform"
+CONF_BITS_PER_PIXEL = "bits_per_pixel"
+CONF_DOUBLE_BUFFER = "double_buffer"
+CONF_BUSY_BACKOFF = "busy_backoff"
+CONF_FRAME_DIFF = "frame_diff"
+CONF_READ_DATA_RATE = "read_data_rate"
+CONF_BAND_HEIGHT = "band_height"
+CONF_TILE_POOL_SIZE = "tile_pool_size"
+CONF_GLYPH_CACHE_SIZE = "glyph_cache_size"
+CONF_DITHER = "dither"
+CONF_IDLE_STANDBY = "idle_standby"
+CONF_ASSETS = "assets"
+CONF_UPDATE_WINDOW = "update_window"
+CONF_MIN_REFRESH_INTERVAL = "min_refresh_interval"
+CONF_REGIONS = "regions"
+CONF_X = "x"
+CONF_Y = "y"
+CONF_MIN_INTERVAL = "min_interval"
+CONF_PRIORITY = "priority"
+CONF_CLEANUP_THRESHOLD = "cleanup_threshold"
+CONF_CLEANUP_DELAY = "cleanup_delay"
+CONF_SPI_SELF_TEST = "spi_self_test"
+CONF_INK = "ink"
+CONF_TOUCHSCREEN_ID = "touchscreen_id"
+CONF_PEN_SIZE = "pen_size"
+
+# Highest SPI clock the IT8951 host interface is specified for
+MAX_DATA_RATE = 24e6
+
 it8951e_ns = cg.esphome_ns.namespace("it8951e")
 it8951e = it8951e_ns.class_(
     "it8951e", cg.PollingComponent, spi.SPIDevice, display.DisplayBuffer
 )
+it8951eRef = it8951e.operator("ref")
+IT8951Asset = it8951e_ns.class_("IT8951Asset")
+BinaryWaveform = it8951e_ns.enum("BinaryWaveform")
+BINARY_WAVEFORMS = {
+    "GC16": BinaryWaveform.BINARY_WAVEFORM_GC16,
+    "DU": BinaryWaveform.BINARY_WAVEFORM_DU,
+    "A2": BinaryWaveform.BINARY_WAVEFORM_A2,
+}
+DitherMode = it8951e_ns.enum("DitherMode")
+DITHER_MODES = {
+    "NONE": DitherMode.DITHER_NONE,
+    "BAYER": DitherMode.DITHER_BAYER,
+    "FLOYD_STEINBERG": DitherMode.DITHER_FLOYD_STEINBERG,
+}
+
+
+def rle_encode(data):
+    """Runs of 3 or more equal bytes become (0x80 | count - 1, byte), the rest (count - 1, bytes...)."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        run = 1
+        while i + run < len(data) and run < 128 and data[i + run] == data[i]:
+            run += 1
+        if run >= 3:
+            out += bytes([0x80 | (run - 1), data[i]])
+            i += run
+            continue
+        start = i
+        while i < len(data) and i - start < 128:
+            if i + 2 < len(data) and data[i] == data[i + 1] == data[i + 2]:
+                break
+            i += 1
+        out.append(i - start - 1)
+        out += data[start:i]
+    return out
+
+
+def pack_asset(path, resize):
+    from PIL import Image
+
+    image = Image.open(path)
+    if resize:
+        image.thumbnail(resize)
+    image = image.convert("L")
+    width, height = image.size
+    # 16 gray levels, 0 is black like on the controller. Leftmost pixel in the
+    # low nibble, rows padded to whole words (4 pixels) with white.
+    padded = (width + 3) & ~3
+    pixels = image.tobytes()
+    data = bytearray()
+    for y in range(height):
+        row = [pixels[y * width + x] >> 4 for x in range(width)]
+        row += [0xF] * (padded - width)
+        for x in range(0, padded, 2):
+            data.append(row[x] | (row[x + 1] << 4))
+    return width, height, data
+
+
+ASSET_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_ID): cv.declare_id(IT8951Asset),
+        cv.Required(CONF_FILE): cv.file_,
+        cv.Optional(CONF_RESIZE): cv.dimensions,
+        cv.GenerateID(CONF_RAW_DATA_ID): cv.declare_id(cg.uint8),
+    }
+)
+
+
+REGION_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_X): cv.int_range(min=0, max=4095),
+        cv.Required(CONF_Y): cv.int_range(min=0, max=4095),
+        cv.Required(CONF_WIDTH): cv.int_range(min=1, max=4096),
+        cv.Required(CONF_HEIGHT): cv.int_range(min=1, max=4096),
+        cv.Optional(
+            CONF_MIN_INTERVAL, default="0ms"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_PRIORITY, default=False): cv.boolean,
+    }
+)
+
+
+def ink_touchscreen_id(value):
+    # Only configurations with ink need the gt911 component loaded
+    from esphome.components.gt911.sensor import GT911
+
+    return cv.use_id(GT911)(value)
+
+
+INK_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_TOUCHSCREEN_ID): ink_touchscreen_id,
+        cv.Optional(CONF_PEN_SIZE, default=3): cv.int_range(min=1, max=32),
+    }
+)
+
+
+def validate_data_rate(config):
+    if config[CONF_DATA_RATE] > MAX_DATA_RATE:
+        raise cv.Invalid(
+            f"The IT8951 supports at most {MAX_DATA_RATE / 1e6:.0f}MHz",
+            path=[CONF_DATA_RATE],
+        )
+    return config
+
+
+def validate_band_height(config):
+    for key in (CONF_BAND_HEIGHT, CONF_TILE_POOL_SIZE):
+        if key in config and config[CONF_DOUBLE_BUFFER]:
+            raise cv.Invalid(f"{key} can't be combined with {CONF_DOUBLE_BUFFER}")
+    # Regions are sorted per tile of the whole frame, which neither strips nor the second buffer keep
+    if CONF_REGIONS in config:
+        for key in (CONF_BAND_HEIGHT, CONF_TILE_POOL_SIZE):
+            if key in config:
+                raise cv.Invalid(f"{CONF_REGIONS} can't be combined with {key}")
+        if config[CONF_DOUBLE_BUFFER]:
+            raise cv.Invalid(f"{CONF_REGIONS} can't be combined with {CONF_DOUBLE_BUFFER}")
+    return config
+
+
+def validate_ink(config):
+    # Strokes are drawn into the whole frame and sent from loop()
+    if CONF_INK not in config:
+        return config
+    for key in (CONF_BAND_HEIGHT, CONF_TILE_POOL_SIZE):
+        if key in config:
+            raise cv.Invalid(f"{CONF_INK} can't be combined with {key}")
+    if config[CONF_DOUBLE_BUFFER]:
+        raise cv.Invalid(f"{CONF_INK} can't be combined with {CONF_DOUBLE_BUFFER}")
+    # Strokes only live in the frame, auto clear would erase them on every update
+    if config.get(CONF_AUTO_CLEAR_ENABLED) is not False:
+        raise cv.Invalid(
+            f"{CONF_INK} needs {CONF_AUTO_CLEAR_ENABLED}: false",
+            path=[CONF_AUTO_CLEAR_ENABLED],
+        )
+    return config
+
 
 CONFIG_SCHEMA = cv.All(
     display.FULL_DISPLAY_SCHEMA.extend(
@@ -24,13 +201,65 @@ CONFIG_SCHEMA = cv.All(
             cv.GenerateID(): cv.declare_id(it8951e),
             # cv.Required(CONF_CS_PIN): pins.gpio_output_pin_schema,
             cv.Optional(CONF_RESET_PIN): pins.gpio_output_pin_schema,
-            cv.Optional(CONF_BUSY_PIN): pins.gpio_input_pin_schema,
+            cv.Optional(CONF_BUSY_PIN): pins.internal_gpio_input_pin_schema,
+            cv.Optional(
+                CONF_BUSY_BACKOFF, default="8ms"
+            ): cv.positive_time_period_milliseconds,
             cv.Optional(CONF_FULL_UPDATE_EVERY): cv.uint32_t,
+            # GC16 for tiles that got this many fast refreshes, instead of flashing the whole panel
+            cv.Optional(CONF_CLEANUP_THRESHOLD): cv.int_range(min=1, max=255),
+            cv.Optional(
+                CONF_CLEANUP_DELAY, default="5s"
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_TRANSFER_CHUNK_SIZE, default=4096): cv.int_range(
+                min=64, max=65536
+            ),
+            cv.Optional(CONF_DMA_BUFFER, default=False): cv.boolean,
+            cv.Optional(CONF_BITS_PER_PIXEL, default=4): cv.one_of(1, 2, 4, 8, int=True),
+            # Runs the SPI transfer in its own task, the SPI bus must not be shared
+            cv.Optional(CONF_DOUBLE_BUFFER, default=False): cv.boolean,
+            cv.Optional(CONF_FRAME_DIFF, default=True): cv.boolean,
+            # Renders in horizontal strips of this many rows instead of keeping a full frame,
+            # with frame_diff rounded up to whole 32 row tiles so each strip can be diffed
+            cv.Optional(CONF_BAND_HEIGHT): cv.int_range(min=1, max=2048),
+            # Keeps the frame as compressed tiles in a pool of this many bytes, renders in bands
+            cv.Optional(CONF_TILE_POOL_SIZE): cv.int_range(min=1024, max=2097152),
+            cv.Optional(CONF_IDLE_STANDBY, default=False): cv.boolean,
+            # update() calls within this window of the first one are drawn as one frame
+            cv.Optional(
+                CONF_UPDATE_WINDOW, default="0ms"
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(
+                CONF_MIN_REFRESH_INTERVAL, default="0ms"
+            ): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_REGIONS): cv.All(
+                cv.ensure_list(REGION_SCHEMA), cv.Length(max=4)
+            ),
+            cv.Optional(CONF_ASSETS): cv.ensure_list(ASSET_SCHEMA),
+            # Draws the touches into the frame and refreshes them right away with the binary waveform.
+            # Needs auto_clear_enabled: false, strokes stay until the writer draws over them.
+            cv.Optional(CONF_INK): INK_SCHEMA,
+            cv.Optional(CONF_DITHER, default="NONE"): cv.enum(DITHER_MODES, upper=True),
+            cv.Optional(CONF_GLYPH_CACHE_SIZE, default=8192): cv.int_range(
+                min=0, max=1048576
+            ),
+            cv.Optional(CONF_READ_DATA_RATE): cv.All(
+                cv.frequency, cv.float_range(max=MAX_DATA_RATE)
+            ),
+            cv.Optional(CONF_SPI_SELF_TEST, default=True): cv.boolean,
+            cv.Optional(CONF_BINARY_WAVEFORM, default="DU"): cv.enum(
+                BINARY_WAVEFORMS, upper=True
+            ),
         }
     )
     .extend(cv.polling_component_schema("1s"))
-    .extend(spi.spi_device_schema()),
+    .extend(spi.spi_device_schema(default_data_rate="2MHz")),
+    # The word wide line and rectangle kernels aren't virtual in DisplayBuffer, only a lambda gets
+    # them (it is an it8951e &). pages: and ESPHome widgets draw through them pixel by pixel.
     cv.has_at_most_one_key(CONF_PAGES, CONF_LAMBDA),
+    validate_data_rate,
+    validate_band_height,
+    validate_ink,
 )
 
 
@@ -47,7 +276,7 @@ async def to_code(config):
 
     if CONF_LAMBDA in config:
         lambda_ = await cg.process_lambda(
-            config[CONF_LAMBDA], [(display.DisplayBufferRef, "it")], return_type=cg.void
+            config[CONF_LAMBDA], [(it8951eRef, "it")], return_type=cg.void
         )
         cg.add(var.set_writer(lambda_))
     if CONF_RESET_PIN in config:
@@ -56,5 +285,51 @@ async def to_code(config):
     if CONF_BUSY_PIN in config:
         reset = await cg.gpio_pin_expression(config[CONF_BUSY_PIN])
         cg.add(var.set_busy_pin(reset))
+    cg.add(var.set_transfer_chunk_size(config[CONF_TRANSFER_CHUNK_SIZE]))
+    cg.add(var.set_dma_buffer(config[CONF_DMA_BUFFER]))
+    cg.add(var.set_binary_waveform(config[CONF_BINARY_WAVEFORM]))
+    cg.add(var.set_bits_per_pixel(config[CONF_BITS_PER_PIXEL]))
+    cg.add(var.set_double_buffer(config[CONF_DOUBLE_BUFFER]))
+    cg.add(var.set_busy_backoff(config[CONF_BUSY_BACKOFF]))
+    cg.add(var.set_frame_diff(config[CONF_FRAME_DIFF]))
+    cg.add(var.set_dither(config[CONF_DITHER]))
+    cg.add(var.set_idle_standby(config[CONF_IDLE_STANDBY]))
+    cg.add(var.set_update_window(config[CONF_UPDATE_WINDOW]))
+    cg.add(var.set_min_refresh_interval(config[CONF_MIN_REFRESH_INTERVAL]))
+    for region in config.get(CONF_REGIONS, []):
+        cg.add(
+            var.add_region(
+                region[CONF_X],
+                region[CONF_Y],
+                region[CONF_WIDTH],
+                region[CONF_HEIGHT],
+                region[CONF_MIN_INTERVAL],
+                region[CONF_PRIORITY],
+            )
+        )
+
+    cg.add(var.set_glyph_cache_size(config[CONF_GLYPH_CACHE_SIZE]))
+    if CONF_BAND_HEIGHT in config:
+        cg.add(var.set_band_height(config[CONF_BAND_HEIGHT]))
+    if CONF_TILE_POOL_SIZE in config:
+        cg.add(var.set_tile_pool_size(config[CONF_TILE_POOL_SIZE]))
+    cg.add(var.set_spi_self_test(config[CONF_SPI_SELF_TEST]))
+    if CONF_READ_DATA_RATE in config:
+        cg.add(var.set_read_data_rate(int(config[CONF_READ_DATA_RATE])))
     if CONF_FULL_UPDATE_EVERY in config:
         cg.add(var.set_full_update_every(config[CONF_FULL_UPDATE_EVERY]))
+    if CONF_CLEANUP_THRESHOLD in config:
+        cg.add(var.set_cleanup_threshold(config[CONF_CLEANUP_THRESHOLD]))
+        cg.add(var.set_cleanup_delay(config[CONF_CLEANUP_DELAY]))
+    if CONF_INK in config:
+        cg.add_define("USE_IT8951E_INK")
+        touchscreen = await cg.get_variable(config[CONF_INK][CONF_TOUCHSCREEN_ID])
+        cg.add(var.set_ink_touchscreen(touchscreen))
+        cg.add(var.set_ink_pen_size(config[CONF_INK][CONF_PEN_SIZE]))
+
+    for asset in config.get(CONF_ASSETS, []):
+        path = CORE.relative_config_path(asset[CONF_FILE])
+        width, height, data = pack_asset(path, asset.get(CONF_RESIZE))
+        encoded = rle_encode(data)
+        prog_arr = cg.progmem_array(asset[CONF_RAW_DATA_ID], list(encoded))
+        cg.new_Pvariable(asset[CONF_ID], prog_arr, len(encoded), width, height)
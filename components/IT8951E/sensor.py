@@ -0,0 +1,65 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import sensor
+from esphome.const import (
+    ICON_TIMER,
+    STATE_CLASS_MEASUREMENT,
+    UNIT_MILLISECOND,
+)
+from .display import it8951e
+
+CONF_IT8951E_ID = "it8951e_id"
+CONF_RENDER_TIME = "render_time"
+CONF_PACK_TIME = "pack_time"
+CONF_TRANSFER_TIME = "transfer_time"
+CONF_BYTES_SENT = "bytes_sent"
+CONF_BUSY_WAIT_TIME = "busy_wait_time"
+CONF_LUT_TIME = "lut_time"
+
+UNIT_BYTES = "B"
+ICON_TRANSFER = "mdi:swap-horizontal"
+
+TIME_SENSORS = [
+    CONF_RENDER_TIME,
+    CONF_PACK_TIME,
+    CONF_TRANSFER_TIME,
+    CONF_BUSY_WAIT_TIME,
+    CONF_LUT_TIME,
+]
+
+TIME_SCHEMA = sensor.sensor_schema(
+    unit_of_measurement=UNIT_MILLISECOND,
+    icon=ICON_TIMER,
+    accuracy_decimals=2,
+    state_class=STATE_CLASS_MEASUREMENT,
+)
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(CONF_IT8951E_ID): cv.use_id(it8951e),
+        cv.Optional(CONF_RENDER_TIME): TIME_SCHEMA,
+        cv.Optional(CONF_PACK_TIME): TIME_SCHEMA,
+        cv.Optional(CONF_TRANSFER_TIME): TIME_SCHEMA,
+        cv.Optional(CONF_BUSY_WAIT_TIME): TIME_SCHEMA,
+        cv.Optional(CONF_LUT_TIME): sensor.sensor_schema(
+            unit_of_measurement=UNIT_MILLISECOND,
+            icon=ICON_TIMER,
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+        cv.Optional(CONF_BYTES_SENT): sensor.sensor_schema(
+            unit_of_measurement=UNIT_BYTES,
+            icon=ICON_TRANSFER,
+            accuracy_decimals=0,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+    }
+)
+
+
+async def to_code(config):
+    parent = await cg.get_variable(config[CONF_IT8951E_ID])
+    for key in TIME_SENSORS + [CONF_BYTES_SENT]:
+        if key in config:
+            sens = await sensor.new_sensor(config[key])
+            cg.add(getattr(parent, f"set_{key}_sensor")(sens))
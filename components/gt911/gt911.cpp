@@ -20,10 +20,32 @@ void GT911::update(){
   if(!this->setupComplete){
     return;
   }
-  this->readTouches();
+  // With touch callbacks loop() reads the points, don't steal them from it
+  if(!this->hasTouchCallbacks){
+    this->readTouches();
+  }
   this->publish_state(touches);
 }
 
+void GT911::loop(){
+  if(!this->setupComplete || !this->hasTouchCallbacks){
+    return;
+  }
+  // Point info has the buffer status bit set once new coordinates are ready
+  uint8_t pointInfo = this->readByteData(GT911_POINT_INFO);
+  if((pointInfo >> 7 & 1) == 0){
+    return;
+  }
+  this->readTouches(pointInfo);
+  // An empty report means every finger was lifted
+  this->touchCallback.call(points, isTouched ? (touches < 5 ? touches : 5) : 0);
+}
+
+void GT911::add_touch_callback(std::function<void(const TP_Point *, uint8_t)> &&callback){
+  this->hasTouchCallbacks = true;
+  this->touchCallback.add(std::move(callback));
+}
+
 void GT911::dump_config(){
   ESP_LOGCONFIG(TAG, "GT911:");
   ESP_LOGCONFIG(TAG, "  Address: 0x%02X", this->address_);
@@ -57,12 +79,14 @@ void GT911::setResolution(uint16_t _width, uint16_t _height) {
   this->reflashConfig();
 }
 void GT911::readTouches(void) {
+  this->readTouches(this->readByteData(GT911_POINT_INFO));
+}
+void GT911::readTouches(uint8_t pointInfo) {
   // Serial.println("TAMC_GT911::read");
   uint8_t data[7];
   uint8_t id;
   uint16_t x, y, size;
 
-  uint8_t pointInfo = this->readByteData(GT911_POINT_INFO);
   uint8_t bufferStatus = pointInfo >> 7 & 1;
   uint8_t proximityValid = pointInfo >> 5 & 1;
   uint8_t haveKey = pointInfo >> 4 & 1;
@@ -126,13 +150,16 @@ uint8_t GT911::readByteData(uint16_t reg) {
 }
 
 void GT911::writeBlockData(uint16_t reg, uint8_t *val, uint8_t size) {
-  this->write((uint8_t*)&reg, 2);
+  // Register addresses go out high byte first
+  uint8_t addr[2] = {highByte(reg), lowByte(reg)};
+  this->write(addr, 2);
   this->write(val, size);
 }
 
 bool GT911::readBlockData(uint8_t *buf, uint16_t reg, uint8_t size) {
   esphome::i2c::ErrorCode e;
-  e = this->write((uint8_t*)&reg, 2);
+  uint8_t addr[2] = {highByte(reg), lowByte(reg)};
+  e = this->write(addr, 2);
   if(e != esphome::i2c::ERROR_OK){
     return false;
   }
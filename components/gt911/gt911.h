@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
 #include "esphome/components/sensor/sensor.h"
 #include "esphome/components/i2c/i2c.h"
 
@@ -159,13 +160,20 @@ class GT911 : public sensor::Sensor, public PollingComponent, public i2c::I2CDev
   public:
     void setup() override;
     void update() override;
+    void loop() override;
     void dump_config() override;
 
+    // Called from loop() with every new set of touch points as soon as the controller reports them,
+    // and with none once all fingers are lifted
+    void add_touch_callback(std::function<void(const TP_Point *, uint8_t)> &&callback);
+
     void calculate_checksum();
     void reflashConfig();
     void setRotation(uint8_t rot);
     void setResolution(uint16_t _width, uint16_t _height);
     void readTouches(void);
+    // Same, with the point info register already read
+    void readTouches(uint8_t pointInfo);
     TP_Point readPoint(uint8_t *data);
     void writeByteData(uint16_t reg, uint8_t val);
     uint8_t readByteData(uint16_t reg);
@@ -182,6 +190,8 @@ class GT911 : public sensor::Sensor, public PollingComponent, public i2c::I2CDev
     bool isTouched = false;
     bool setupComplete = false;
     TP_Point points[5];
+    bool hasTouchCallbacks = false;
+    CallbackManager<void(const TP_Point *, uint8_t)> touchCallback;
 };
 
 }  // namespace gt911
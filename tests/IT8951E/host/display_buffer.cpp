@@ -0,0 +1,175 @@
+#include "esphome/components/display/display_buffer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace display {
+
+const Color COLOR_OFF(0, 0, 0, 0);
+const Color COLOR_ON(255, 255, 255, 255);
+
+void Rect::shrink(Rect rect) {
+  if (!this->is_set()) {
+    *this = rect;
+    return;
+  }
+  if (!rect.is_set())
+    return;
+  const int16_t x0 = std::max(this->x, rect.x), y0 = std::max(this->y, rect.y);
+  const int16_t x1 = std::min(this->x2(), rect.x2()), y1 = std::min(this->y2(), rect.y2());
+  this->x = x0;
+  this->y = y0;
+  this->w = std::max<int16_t>(0, x1 - x0);
+  this->h = std::max<int16_t>(0, y1 - y0);
+}
+
+bool Rect::inside(int16_t x, int16_t y, bool absolute) const {
+  if (!this->is_set())
+    return true;
+  if (absolute)
+    return x >= this->x && x < this->x2() && y >= this->y && y < this->y2();
+  return x >= 0 && x < this->w && y >= 0 && y < this->h;
+}
+
+int DisplayBuffer::get_width() {
+  if (this->rotation_ == DISPLAY_ROTATION_90_DEGREES || this->rotation_ == DISPLAY_ROTATION_270_DEGREES)
+    return this->get_height_internal();
+  return this->get_width_internal();
+}
+
+int DisplayBuffer::get_height() {
+  if (this->rotation_ == DISPLAY_ROTATION_90_DEGREES || this->rotation_ == DISPLAY_ROTATION_270_DEGREES)
+    return this->get_width_internal();
+  return this->get_height_internal();
+}
+
+void DisplayBuffer::fill(Color color) { this->filled_rectangle(0, 0, this->get_width(), this->get_height(), color); }
+
+void DisplayBuffer::draw_pixel_at(int x, int y, Color color) {
+  if (!this->get_clipping().inside(x, y))
+    return;
+  switch (this->rotation_) {
+    case DISPLAY_ROTATION_0_DEGREES:
+      break;
+    case DISPLAY_ROTATION_90_DEGREES:
+      std::swap(x, y);
+      x = this->get_width_internal() - x - 1;
+      break;
+    case DISPLAY_ROTATION_180_DEGREES:
+      x = this->get_width_internal() - x - 1;
+      y = this->get_height_internal() - y - 1;
+      break;
+    case DISPLAY_ROTATION_270_DEGREES:
+      std::swap(x, y);
+      y = this->get_height_internal() - y - 1;
+      break;
+  }
+  this->draw_absolute_pixel_internal(x, y, color);
+}
+
+void DisplayBuffer::line(int x1, int y1, int x2, int y2, Color color) {
+  const int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+  const int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+  int err = dx + dy;
+  while (true) {
+    this->draw_pixel_at(x1, y1, color);
+    if (x1 == x2 && y1 == y2)
+      break;
+    const int e2 = 2 * err;
+    if (e2 >= dy) {
+      err += dy;
+      x1 += sx;
+    }
+    if (e2 <= dx) {
+      err += dx;
+      y1 += sy;
+    }
+  }
+}
+
+void DisplayBuffer::horizontal_line(int x, int y, int width, Color color) {
+  for (int i = x; i < x + width; i++)
+    this->draw_pixel_at(i, y, color);
+}
+
+void DisplayBuffer::vertical_line(int x, int y, int height, Color color) {
+  for (int i = y; i < y + height; i++)
+    this->draw_pixel_at(x, i, color);
+}
+
+void DisplayBuffer::rectangle(int x1, int y1, int width, int height, Color color) {
+  this->horizontal_line(x1, y1, width, color);
+  this->horizontal_line(x1, y1 + height - 1, width, color);
+  this->vertical_line(x1, y1, height, color);
+  this->vertical_line(x1 + width - 1, y1, height, color);
+}
+
+void DisplayBuffer::filled_rectangle(int x1, int y1, int width, int height, Color color) {
+  for (int i = y1; i < y1 + height; i++)
+    this->horizontal_line(x1, i, width, color);
+}
+
+void DisplayBuffer::get_text_bounds(int x, int y, const char *text, BaseFont *font, TextAlign align, int *x1, int *y1,
+                                    int *width, int *height) {
+  int x_offset, baseline;
+  font->measure(text, width, &x_offset, &baseline, height);
+  const int a = static_cast<int>(align);
+  if (a & static_cast<int>(TextAlign::CENTER_HORIZONTAL))
+    *x1 = x - *width / 2;
+  else if (a & static_cast<int>(TextAlign::RIGHT))
+    *x1 = x - *width;
+  else
+    *x1 = x;
+  if (a & static_cast<int>(TextAlign::CENTER_VERTICAL))
+    *y1 = y - *height / 2;
+  else if (a & static_cast<int>(TextAlign::BASELINE))
+    *y1 = y - baseline;
+  else if (a & static_cast<int>(TextAlign::BOTTOM))
+    *y1 = y - *height;
+  else
+    *y1 = y;
+}
+
+void DisplayBuffer::print(int x, int y, BaseFont *font, Color color, TextAlign align, const char *text) {
+  int x1, y1, width, height;
+  this->get_text_bounds(x, y, text, font, align, &x1, &y1, &width, &height);
+  font->print(x1, y1, this, color, text);
+}
+
+void DisplayBuffer::start_clipping(Rect rect) {
+  if (!this->clipping_rectangle_.empty())
+    rect.shrink(this->clipping_rectangle_.back());
+  this->clipping_rectangle_.push_back(rect);
+}
+
+void DisplayBuffer::end_clipping() {
+  if (!this->clipping_rectangle_.empty())
+    this->clipping_rectangle_.pop_back();
+}
+
+Rect DisplayBuffer::get_clipping() {
+  if (this->clipping_rectangle_.empty())
+    return Rect();
+  return this->clipping_rectangle_.back();
+}
+
+void DisplayBuffer::init_internal_(uint32_t buffer_length) {
+  ExternalRAMAllocator<uint8_t> allocator(ExternalRAMAllocator<uint8_t>::ALLOW_FAILURE);
+  this->buffer_ = allocator.allocate(buffer_length);
+  if (this->buffer_ != nullptr)
+    memset(this->buffer_, 0, buffer_length);
+}
+
+// Same order as Display::do_update_(): clear() under the caller's clipping, the writer, then the clipping is dropped.
+void DisplayBuffer::do_update_() {
+  if (this->auto_clear_enabled_)
+    this->clear();
+  if (this->writer_)
+    this->writer_(*this);
+  this->clipping_rectangle_.clear();
+}
+
+}  // namespace display
+}  // namespace esphome
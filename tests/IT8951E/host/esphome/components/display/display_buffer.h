@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "esphome/core/color.h"
+#include "esphome/core/component.h"
+
+// Host version of the ESPHome DisplayBuffer, with the software rotation, clipping and drawing
+// primitives the IT8951E driver falls back to. Implemented in host/display_buffer.cpp.
+
+namespace esphome {
+namespace display {
+
+enum DisplayRotation {
+  DISPLAY_ROTATION_0_DEGREES = 0,
+  DISPLAY_ROTATION_90_DEGREES = 90,
+  DISPLAY_ROTATION_180_DEGREES = 180,
+  DISPLAY_ROTATION_270_DEGREES = 270,
+};
+
+enum class DisplayType {
+  DISPLAY_TYPE_BINARY = 1,
+  DISPLAY_TYPE_GRAYSCALE = 2,
+  DISPLAY_TYPE_COLOR = 3,
+};
+
+enum class TextAlign {
+  TOP = 0x00,
+  CENTER_VERTICAL = 0x01,
+  BASELINE = 0x02,
+  BOTTOM = 0x04,
+
+  LEFT = 0x00,
+  CENTER_HORIZONTAL = 0x08,
+  RIGHT = 0x10,
+
+  TOP_LEFT = TOP | LEFT,
+  TOP_CENTER = TOP | CENTER_HORIZONTAL,
+  TOP_RIGHT = TOP | RIGHT,
+  CENTER_LEFT = CENTER_VERTICAL | LEFT,
+  CENTER = CENTER_VERTICAL | CENTER_HORIZONTAL,
+  CENTER_RIGHT = CENTER_VERTICAL | RIGHT,
+  BASELINE_LEFT = BASELINE | LEFT,
+  BASELINE_CENTER = BASELINE | CENTER_HORIZONTAL,
+  BASELINE_RIGHT = BASELINE | RIGHT,
+  BOTTOM_LEFT = BOTTOM | LEFT,
+  BOTTOM_CENTER = BOTTOM | CENTER_HORIZONTAL,
+  BOTTOM_RIGHT = BOTTOM | RIGHT,
+};
+
+static const int16_t VALUE_NO_SET = 32766;
+
+class Rect {
+ public:
+  int16_t x{VALUE_NO_SET};
+  int16_t y{VALUE_NO_SET};
+  int16_t w{VALUE_NO_SET};
+  int16_t h{VALUE_NO_SET};
+
+  Rect() = default;
+  Rect(int16_t x, int16_t y, int16_t w, int16_t h) : x(x), y(y), w(w), h(h) {}
+  int16_t x2() const { return this->x + this->w; }
+  int16_t y2() const { return this->y + this->h; }
+  bool is_set() const { return this->w != VALUE_NO_SET && this->h != VALUE_NO_SET; }
+  void shrink(Rect rect);
+  bool inside(int16_t x, int16_t y, bool absolute = true) const;
+};
+
+extern const Color COLOR_OFF;
+extern const Color COLOR_ON;
+
+class DisplayBuffer;
+using display_writer_t = std::function<void(DisplayBuffer &)>;
+
+class BaseFont {
+ public:
+  virtual ~BaseFont() = default;
+  virtual void print(int x, int y, DisplayBuffer *display, Color color, const char *text) = 0;
+  virtual void measure(const char *str, int *width, int *x_offset, int *baseline, int *height) = 0;
+};
+
+class DisplayBuffer {
+ public:
+  virtual ~DisplayBuffer() = default;
+
+  virtual void fill(Color color);
+  void clear() { this->fill(COLOR_OFF); }
+  int get_width();
+  int get_height();
+
+  void draw_pixel_at(int x, int y, Color color = COLOR_ON);
+  void line(int x1, int y1, int x2, int y2, Color color = COLOR_ON);
+  void horizontal_line(int x, int y, int width, Color color = COLOR_ON);
+  void vertical_line(int x, int y, int height, Color color = COLOR_ON);
+  void rectangle(int x1, int y1, int width, int height, Color color = COLOR_ON);
+  void filled_rectangle(int x1, int y1, int width, int height, Color color = COLOR_ON);
+
+  void print(int x, int y, BaseFont *font, Color color, TextAlign align, const char *text);
+  void print(int x, int y, BaseFont *font, Color color, const char *text) {
+    this->print(x, y, font, color, TextAlign::TOP_LEFT, text);
+  }
+  void get_text_bounds(int x, int y, const char *text, BaseFont *font, TextAlign align, int *x1, int *y1, int *width,
+                       int *height);
+
+  void set_writer(display_writer_t &&writer) { this->writer_ = std::move(writer); }
+  void set_rotation(DisplayRotation rotation) { this->rotation_ = rotation; }
+  void set_auto_clear(bool auto_clear_enabled) { this->auto_clear_enabled_ = auto_clear_enabled; }
+  DisplayRotation get_rotation() const { return this->rotation_; }
+  virtual DisplayType get_display_type() = 0;
+
+  void start_clipping(Rect rect);
+  void start_clipping(int16_t left, int16_t top, int16_t right, int16_t bottom) {
+    this->start_clipping(Rect(left, top, right - left, bottom - top));
+  }
+  void end_clipping();
+  Rect get_clipping();
+  bool is_clipping() const { return !this->clipping_rectangle_.empty(); }
+
+ protected:
+  virtual void draw_absolute_pixel_internal(int x, int y, Color color) = 0;
+  virtual int get_height_internal() = 0;
+  virtual int get_width_internal() = 0;
+
+  void init_internal_(uint32_t buffer_length);
+  void do_update_();
+
+  uint8_t *buffer_{nullptr};
+  DisplayRotation rotation_{DISPLAY_ROTATION_0_DEGREES};
+  display_writer_t writer_;
+  bool auto_clear_enabled_{true};
+  std::vector<Rect> clipping_rectangle_;
+};
+
+}  // namespace display
+}  // namespace esphome
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+// Only what the GT911 header needs, the IT8951E sensors are not built on the host.
+
+namespace esphome {
+namespace sensor {
+
+class Sensor {
+ public:
+  void publish_state(float state) { this->state = state; }
+
+  float state{0};
+};
+
+}  // namespace sensor
+}  // namespace esphome
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esphome/core/component.h"
+
+// Host version of the ESPHome SPI API. Devices talk to an SPIComponent, which on the host is a
+// simulated bus backend (see tests/IT8951E/it8951_sim.h) instead of a hardware SPI peripheral.
+
+namespace esphome {
+namespace spi {
+
+enum SPIBitOrder { BIT_ORDER_LSB_FIRST, BIT_ORDER_MSB_FIRST };
+enum SPIClockPolarity { CLOCK_POLARITY_LOW = 0, CLOCK_POLARITY_HIGH = 1 };
+enum SPIClockPhase { CLOCK_PHASE_LEADING, CLOCK_PHASE_TRAILING };
+enum SPIDataRate : uint32_t {
+  DATA_RATE_1KHZ = 1000,
+  DATA_RATE_200KHZ = 200000,
+  DATA_RATE_1MHZ = 1000000,
+  DATA_RATE_2MHZ = 2000000,
+  DATA_RATE_4MHZ = 4000000,
+  DATA_RATE_5MHZ = 5000000,
+  DATA_RATE_8MHZ = 8000000,
+  DATA_RATE_10MHZ = 10000000,
+  DATA_RATE_20MHZ = 20000000,
+  DATA_RATE_40MHZ = 40000000,
+  DATA_RATE_80MHZ = 80000000,
+};
+
+class SPIClient;
+
+/// Bus backend: devices register with their clock, then exchange bytes between begin and end of a transaction.
+class SPIComponent {
+ public:
+  virtual ~SPIComponent() = default;
+  virtual void register_device(SPIClient *device, uint32_t data_rate) = 0;
+  virtual void unregister_device(SPIClient *device) = 0;
+  virtual void begin_transaction(SPIClient *device) = 0;
+  virtual uint8_t transfer(uint8_t data) = 0;
+  virtual void end_transaction(SPIClient *device) = 0;
+};
+
+class SPIClient {
+ public:
+  virtual ~SPIClient() = default;
+  virtual void spi_setup() {
+    if (this->parent_ != nullptr)
+      this->parent_->register_device(this, this->data_rate_);
+  }
+  virtual void spi_teardown() {
+    if (this->parent_ != nullptr)
+      this->parent_->unregister_device(this);
+  }
+  void set_spi_parent(SPIComponent *parent) { this->parent_ = parent; }
+  void set_cs_pin(GPIOPin *cs) { this->cs_ = cs; }
+  void set_data_rate(uint32_t data_rate) { this->data_rate_ = data_rate; }
+
+ protected:
+  uint32_t data_rate_{1000000};
+  SPIComponent *parent_{nullptr};
+  GPIOPin *cs_{nullptr};
+};
+
+template<SPIBitOrder BIT_ORDER, SPIClockPolarity CLOCK_POLARITY, SPIClockPhase CLOCK_PHASE, SPIDataRate DATA_RATE>
+class SPIDevice : public SPIClient {
+ public:
+  SPIDevice() { this->data_rate_ = DATA_RATE; }
+
+  void enable() { this->parent_->begin_transaction(this); }
+  void disable() { this->parent_->end_transaction(this); }
+
+  uint8_t read_byte() { return this->parent_->transfer(0x00); }
+  void read_array(uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++)
+      data[i] = this->parent_->transfer(0x00);
+  }
+  void write_byte(uint8_t data) { this->parent_->transfer(data); }
+  void write_byte16(uint16_t data) {
+    this->parent_->transfer(data >> 8);
+    this->parent_->transfer(data);
+  }
+  void write_array(const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++)
+      this->parent_->transfer(data[i]);
+  }
+  void write_array16(const uint16_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++)
+      this->write_byte16(data[i]);
+  }
+  void transfer_array(uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++)
+      data[i] = this->parent_->transfer(data[i]);
+  }
+};
+
+}  // namespace spi
+}  // namespace esphome
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+
+struct Color {
+  union {
+    struct {
+      union {
+        uint8_t r;
+        uint8_t red;
+      };
+      union {
+        uint8_t g;
+        uint8_t green;
+      };
+      union {
+        uint8_t b;
+        uint8_t blue;
+      };
+      union {
+        uint8_t w;
+        uint8_t white;
+      };
+    };
+    uint32_t raw_32;
+  };
+
+  constexpr Color() : raw_32(0) {}
+  constexpr Color(uint8_t red, uint8_t green, uint8_t blue, uint8_t white = 0)
+      : r(red), g(green), b(blue), w(white) {}
+  bool is_on() const { return this->raw_32 != 0; }
+};
+
+}  // namespace esphome
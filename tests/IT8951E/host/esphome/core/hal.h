@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+// Host stand-ins for the ESPHome HAL. Time is simulated: it only moves when
+// something waits or when the simulated SPI bus clocks bytes out, which makes
+// every run of the tests and the benchmark reproduce the same numbers.
+
+#define IRAM_ATTR
+#define HOT
+#define PROGMEM
+
+namespace esphome {
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+inline uint8_t progmem_read_byte(const uint8_t *addr) { return *addr; }
+
+namespace host {
+/// Simulated time since start, in microseconds.
+uint64_t now_us();
+void advance_us(uint64_t us);
+}  // namespace host
+
+}  // namespace esphome
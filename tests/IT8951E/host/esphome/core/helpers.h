@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace esphome {
+
+template<class T> class ExternalRAMAllocator {
+ public:
+  using value_type = T;
+  enum Flags {
+    NONE = 0,
+    REFUSE_INTERNAL = 1 << 0,
+    ALLOW_FAILURE = 1 << 1,
+  };
+  ExternalRAMAllocator() = default;
+  ExternalRAMAllocator(uint8_t flags) {}
+  T *allocate(size_t n) { return static_cast<T *>(calloc(n, sizeof(T))); }  // NOLINT
+  void deallocate(T *p, size_t n) { free(p); }                              // NOLINT
+};
+
+template<typename... X> class CallbackManager;
+template<typename... Ts> class CallbackManager<void(Ts...)> {
+ public:
+  void add(std::function<void(Ts...)> &&callback) { this->callbacks_.push_back(std::move(callback)); }
+  void call(Ts... args) {
+    for (auto &cb : this->callbacks_)
+      cb(args...);
+  }
+
+ protected:
+  std::vector<std::function<void(Ts...)>> callbacks_;
+};
+
+}  // namespace esphome
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+
+namespace esphome {
+namespace host {
+/// Messages below this level (0 error .. 4 verbose) are dropped, warnings by default.
+extern int log_level;
+}  // namespace host
+}  // namespace esphome
+
+#define ESPHOME_HOST_LOG(level, letter, tag, format, ...) \
+  do { \
+    if ((level) <= esphome::host::log_level) \
+      printf("[" letter "][%s] " format "\n", tag, ##__VA_ARGS__); \
+  } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESPHOME_HOST_LOG(0, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESPHOME_HOST_LOG(1, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESPHOME_HOST_LOG(2, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGCONFIG(tag, format, ...) ESPHOME_HOST_LOG(2, "C", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESPHOME_HOST_LOG(3, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESPHOME_HOST_LOG(4, "V", tag, format, ##__VA_ARGS__)
+
+#define LOG_PIN(prefix, pin) (void) (pin)
+#define LOG_UPDATE_INTERVAL(this) (void) (this)
+#define LOG_DISPLAY(prefix, type, obj) (void) (obj)
+#define LOG_SENSOR(prefix, type, obj) (void) (obj)
+
+#define YESNO(b) ((b) ? "YES" : "NO")
+#define ONOFF(b) ((b) ? "ON" : "OFF")
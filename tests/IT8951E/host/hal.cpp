@@ -0,0 +1,45 @@
+#include "esphome/core/component.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+
+#include <atomic>
+#include <thread>
+
+namespace esphome {
+
+namespace setup_priority {
+const float BUS = 1000.0f;
+const float IO = 900.0f;
+const float HARDWARE = 800.0f;
+const float DATA = 600.0f;
+const float PROCESSOR = 400.0f;
+}  // namespace setup_priority
+
+namespace host {
+
+int log_level = 1;
+
+static std::atomic<uint64_t> clock_us{0};
+
+uint64_t now_us() { return clock_us.load(); }
+void advance_us(uint64_t us) { clock_us += us; }
+
+}  // namespace host
+
+uint32_t micros() { return (uint32_t) host::now_us(); }
+uint32_t millis() { return (uint32_t) (host::now_us() / 1000); }
+
+void delay(uint32_t ms) {
+  host::advance_us(uint64_t(ms) * 1000);
+  //Waiting hands the CPU to the other thread, as sleeping would on the ESP
+  std::this_thread::yield();
+}
+
+void delayMicroseconds(uint32_t us) {
+  host::advance_us(us);
+  std::this_thread::yield();
+}
+
+void yield() { std::this_thread::yield(); }
+
+}  // namespace esphome
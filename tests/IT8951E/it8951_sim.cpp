@@ -0,0 +1,612 @@
+#include "it8951_sim.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+#include "esphome/core/hal.h"
+
+namespace it8951_sim {
+
+using esphome::host::advance_us;
+using esphome::host::now_us;
+
+static const uint16_t PREAMBLE_COMMAND = 0x6000;
+static const uint16_t PREAMBLE_WRITE = 0x0000;
+static const uint16_t PREAMBLE_READ = 0x1000;
+
+static const uint16_t CMD_SYS_RUN = 0x0001;
+static const uint16_t CMD_STANDBY = 0x0002;
+static const uint16_t CMD_SLEEP = 0x0003;
+static const uint16_t CMD_REG_RD = 0x0010;
+static const uint16_t CMD_REG_WR = 0x0011;
+static const uint16_t CMD_MEM_BST_RD_T = 0x0012;
+static const uint16_t CMD_MEM_BST_RD_S = 0x0013;
+static const uint16_t CMD_MEM_BST_WR = 0x0014;
+static const uint16_t CMD_MEM_BST_END = 0x0015;
+static const uint16_t CMD_LD_IMG = 0x0020;
+static const uint16_t CMD_LD_IMG_AREA = 0x0021;
+static const uint16_t CMD_LD_IMG_END = 0x0022;
+static const uint16_t CMD_DPY_AREA = 0x0034;
+static const uint16_t CMD_DPY_BUF_AREA = 0x0037;
+static const uint16_t CMD_GET_DEV_INFO = 0x0302;
+
+static const uint16_t REG_I80CPCR = 0x0004;
+static const uint16_t REG_LISAR = 0x0208;
+static const uint16_t REG_UP1SR = 0x1138;
+static const uint16_t REG_LUTAFSR = 0x1224;
+static const uint16_t REG_BGVR = 0x1250;
+
+/// How long HRDY stays low after each kind of word, in microseconds.
+static const uint32_t PREAMBLE_BUSY_US = 1;
+static const uint32_t COMMAND_BUSY_US = 10;
+static const uint32_t ARGUMENT_BUSY_US = 5;
+
+bool HrdyPin::digital_read() { return this->controller_->is_ready(); }
+
+Controller::Controller(uint16_t width, uint16_t height, const char *lut_version)
+    : hrdy_pin_(this), width_(width), height_(height), lut_version_(lut_version) {
+  //Displayed image, scratch row and a generous amount of off-screen memory behind it
+  this->memory_.assign(IMAGE_ADDR + (uint32_t) width * height * 4 + 0x1000, 0xFF);
+  this->panel_.assign((uint32_t) width * height, 0xFF);
+  this->registers_[REG_LISAR] = IMAGE_ADDR & 0xFFFF;
+  this->registers_[REG_LISAR + 2] = IMAGE_ADDR >> 16;
+  this->registers_[REG_BGVR] = 0xFF00;
+}
+
+//-----------------------------------------------------------
+// Bus
+//-----------------------------------------------------------
+void Controller::register_device(esphome::spi::SPIClient *device, uint32_t data_rate) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  this->devices_[device] = data_rate;
+  this->stats_.device_setups++;
+}
+
+void Controller::unregister_device(esphome::spi::SPIClient *device) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  this->devices_.erase(device);
+}
+
+void Controller::begin_transaction(esphome::spi::SPIClient *device) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  if (this->active_ != nullptr)
+    this->bus_errors_++;
+  auto it = this->devices_.find(device);
+  if (it == this->devices_.end()) {
+    this->bus_errors_++;
+    this->byte_us_ = 8.0;
+  } else {
+    this->byte_us_ = 8e6 / it->second;
+  }
+  this->active_ = device;
+  this->mode_ = MODE_IDLE;
+  this->byte_index_ = 0;
+  this->preamble_ = 0;
+  this->stats_.transactions++;
+}
+
+void Controller::end_transaction(esphome::spi::SPIClient *device) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  if (this->active_ != device)
+    this->bus_errors_++;
+  if (this->byte_index_ < 2 || (this->mode_ == MODE_COMMAND && this->byte_index_ != 4) ||
+      (this->mode_ == MODE_WRITE && this->byte_index_ % 2 != 0))
+    this->bus_errors_++;
+  this->active_ = nullptr;
+  this->mode_ = MODE_IDLE;
+}
+
+uint8_t Controller::transfer(uint8_t data) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  if (this->active_ == nullptr) {
+    this->bus_errors_++;
+    return 0;
+  }
+  uint8_t out = 0;
+  if (this->byte_index_ < 2) {
+    if (this->byte_index_ == 0)
+      this->check_ready_();
+    this->preamble_ = (this->preamble_ << 8) | data;
+    if (this->byte_index_ == 1) {
+      switch (this->preamble_) {
+        case PREAMBLE_COMMAND:
+          this->mode_ = MODE_COMMAND;
+          this->stats_.command_transactions++;
+          break;
+        case PREAMBLE_WRITE:
+          this->mode_ = MODE_WRITE;
+          this->stats_.write_transactions++;
+          break;
+        case PREAMBLE_READ:
+          this->mode_ = MODE_READ;
+          this->stats_.read_transactions++;
+          this->stats_.read_data_rate = this->devices_.count(this->active_) ? this->devices_[this->active_] : 0;
+          break;
+        default:
+          this->bus_errors_++;
+          break;
+      }
+      this->busy_for_(PREAMBLE_BUSY_US);
+    }
+  } else {
+    const uint32_t index = this->byte_index_ - 2;
+    const bool high = index % 2 == 0;
+    switch (this->mode_) {
+      case MODE_READ:
+        //Two dummy bytes, then the queued words
+        if (index < 2)
+          break;
+        if (high) {
+          if (this->read_queue_.empty()) {
+            this->bus_errors_++;
+            this->word_ = 0;
+          } else {
+            this->word_ = this->read_queue_.front();
+            this->read_queue_.pop_front();
+          }
+          out = this->word_ >> 8;
+        } else {
+          out = this->word_;
+        }
+        break;
+      case MODE_COMMAND:
+      case MODE_WRITE:
+        if (high) {
+          if (this->mode_ == MODE_COMMAND)
+            this->check_ready_();
+          else if (this->args_.size() < this->args_needed_)
+            this->check_ready_();
+          this->word_ = data << 8;
+        } else {
+          this->word_ |= data;
+          if (this->mode_ == MODE_WRITE)
+            this->data_word_(this->word_);
+          else if (index == 1)
+            this->receive_command_(this->word_);
+          else
+            this->bus_errors_++;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  this->byte_index_++;
+
+  this->stats_.bytes++;
+  this->stats_.wire_us += this->byte_us_;
+  this->wire_debt_us_ += this->byte_us_;
+  if (this->wire_debt_us_ >= 1.0) {
+    const uint64_t whole = (uint64_t) this->wire_debt_us_;
+    advance_us(whole);
+    this->wire_debt_us_ -= whole;
+  }
+  return out;
+}
+
+bool Controller::is_ready() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  advance_us(1);
+  return now_us() >= this->ready_at_;
+}
+
+void Controller::check_ready_() {
+  if (now_us() < this->ready_at_)
+    this->handshake_violations_++;
+}
+
+void Controller::busy_for_(uint32_t us) { this->ready_at_ = std::max(this->ready_at_, now_us() + us); }
+
+//-----------------------------------------------------------
+// Commands
+//-----------------------------------------------------------
+void Controller::receive_command_(uint16_t code) {
+  this->command_counts_[code]++;
+  if (this->power_state_ != CMD_SYS_RUN && code != CMD_SYS_RUN)
+    this->bus_errors_++;
+  if (this->loading_ && code != CMD_LD_IMG_END)
+    this->bus_errors_++;
+  this->command_ = code;
+  this->args_.clear();
+  switch (code) {
+    case CMD_REG_RD:
+    case CMD_LD_IMG:
+      this->args_needed_ = 1;
+      break;
+    case CMD_REG_WR:
+      this->args_needed_ = 2;
+      break;
+    case CMD_MEM_BST_RD_T:
+    case CMD_MEM_BST_WR:
+      this->args_needed_ = 4;
+      break;
+    case CMD_LD_IMG_AREA:
+    case CMD_DPY_AREA:
+      this->args_needed_ = 5;
+      break;
+    case CMD_DPY_BUF_AREA:
+      this->args_needed_ = 7;
+      break;
+    case CMD_SYS_RUN:
+    case CMD_STANDBY:
+    case CMD_SLEEP:
+    case CMD_MEM_BST_RD_S:
+    case CMD_MEM_BST_END:
+    case CMD_LD_IMG_END:
+    case CMD_GET_DEV_INFO:
+      this->args_needed_ = 0;
+      break;
+    default:
+      this->bus_errors_++;
+      this->args_needed_ = 0;
+      break;
+  }
+  this->busy_for_(COMMAND_BUSY_US);
+  if (this->args_needed_ == 0)
+    this->execute_();
+}
+
+void Controller::data_word_(uint16_t word) {
+  if (this->args_.size() < this->args_needed_) {
+    this->args_.push_back(word);
+    this->busy_for_(ARGUMENT_BUSY_US);
+    if (this->args_.size() == this->args_needed_)
+      this->execute_();
+  } else if (this->loading_) {
+    this->load_word_(word);
+  } else if (this->burst_writing_) {
+    this->set_mem_(this->burst_addr_, word);
+    this->set_mem_(this->burst_addr_ + 1, word >> 8);
+    this->burst_addr_ += 2;
+  } else {
+    this->bus_errors_++;
+  }
+}
+
+void Controller::execute_() {
+  const std::vector<uint16_t> &a = this->args_;
+  switch (this->command_) {
+    case CMD_SYS_RUN:
+    case CMD_STANDBY:
+    case CMD_SLEEP:
+      this->power_state_ = this->command_;
+      break;
+    case CMD_REG_RD:
+      this->read_queue_.push_back(this->get_register(a[0]));
+      break;
+    case CMD_REG_WR:
+      this->registers_[a[0]] = a[1];
+      break;
+    case CMD_MEM_BST_RD_T:
+      this->burst_read_addr_ = a[0] | ((uint32_t) a[1] << 16);
+      this->burst_read_count_ = a[2] | ((uint32_t) a[3] << 16);
+      break;
+    case CMD_MEM_BST_RD_S:
+      for (uint32_t i = 0; i < this->burst_read_count_; i++) {
+        const uint32_t addr = this->burst_read_addr_ + i * 2;
+        this->read_queue_.push_back(this->mem_(addr) | (this->mem_(addr + 1) << 8));
+      }
+      break;
+    case CMD_MEM_BST_WR:
+      this->burst_writing_ = true;
+      this->burst_addr_ = a[0] | ((uint32_t) a[1] << 16);
+      break;
+    case CMD_MEM_BST_END:
+      this->burst_writing_ = false;
+      this->read_queue_.clear();
+      break;
+    case CMD_LD_IMG: {
+      const bool turned = (a[0] & 3) == 1 || (a[0] & 3) == 3;
+      this->load_start_(a[0], 0, 0, turned ? this->height_ : this->width_, turned ? this->width_ : this->height_);
+      break;
+    }
+    case CMD_LD_IMG_AREA:
+      this->load_start_(a[0], a[1], a[2], a[3], a[4]);
+      break;
+    case CMD_LD_IMG_END:
+      if (!this->loading_ || this->load_row_ != this->load_h_)
+        this->bus_errors_++;
+      this->loading_ = false;
+      break;
+    case CMD_DPY_AREA:
+      this->display_(a[0], a[1], a[2], a[3], a[4], IMAGE_ADDR);
+      break;
+    case CMD_DPY_BUF_AREA:
+      this->display_(a[0], a[1], a[2], a[3], a[4], a[5] | ((uint32_t) a[6] << 16));
+      break;
+    case CMD_GET_DEV_INFO: {
+      this->read_queue_.push_back(this->width_);
+      this->read_queue_.push_back(this->height_);
+      this->read_queue_.push_back(IMAGE_ADDR & 0xFFFF);
+      this->read_queue_.push_back(IMAGE_ADDR >> 16);
+      //16 byte strings, two characters per word with the first one in the low byte
+      char fw[16] = "SWv_0.2.1T";
+      char lut[16] = {};
+      strncpy(lut, this->lut_version_.c_str(), sizeof(lut) - 1);
+      for (int i = 0; i < 8; i++)
+        this->read_queue_.push_back((uint8_t) fw[i * 2] | ((uint8_t) fw[i * 2 + 1] << 8));
+      for (int i = 0; i < 8; i++)
+        this->read_queue_.push_back((uint8_t) lut[i * 2] | ((uint8_t) lut[i * 2 + 1] << 8));
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+//-----------------------------------------------------------
+// Image loads
+//-----------------------------------------------------------
+void Controller::load_start_(uint16_t arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+  static const uint8_t BITS[4] = {2, 3, 4, 8};
+  this->load_swap_ = ((arg >> 8) & 1) != 0;
+  this->load_bits_ = BITS[(arg >> 4) & 3];
+  this->load_rotate_ = arg & 3;
+  if (this->load_bits_ == 3)
+    this->bus_errors_++;
+  this->load_x_ = x;
+  this->load_y_ = y;
+  this->load_w_ = w;
+  this->load_h_ = h;
+  this->load_base_ = this->registers_[REG_LISAR] | ((uint32_t) this->registers_[REG_LISAR + 2] << 16);
+  this->load_col_ = 0;
+  this->load_row_ = 0;
+  this->loading_ = true;
+  this->load_threads_.insert(std::this_thread::get_id());
+
+  //The whole area is checked up front, loading pixels a LUT engine still reads corrupts the refresh
+  if (this->load_base_ != IMAGE_ADDR)
+    return;
+  uint16_t x0 = x, y0 = y, x1 = x + w - 1, y1 = y + h - 1;
+  if (this->registers_[REG_UP1SR + 2] & (1 << 2)) {
+    x0 *= 8;
+    x1 = x1 * 8 + 7;
+  }
+  switch (this->load_rotate_) {
+    case 1:
+      std::tie(x0, y0, x1, y1) = std::make_tuple(this->width_ - 1 - y1, x0, this->width_ - 1 - y0, x1);
+      break;
+    case 2:
+      std::tie(x0, y0, x1, y1) =
+          std::make_tuple(this->width_ - 1 - x1, this->height_ - 1 - y1, this->width_ - 1 - x0, this->height_ - 1 - y0);
+      break;
+    case 3:
+      std::tie(x0, y0, x1, y1) = std::make_tuple(y0, this->height_ - 1 - x1, y1, this->height_ - 1 - x0);
+      break;
+    default:
+      break;
+  }
+  if (this->overlaps_busy_(x0, y0, x1, y1))
+    this->load_violations_++;
+}
+
+void Controller::load_word_(uint16_t word) {
+  if (this->load_row_ >= this->load_h_) {
+    this->bus_errors_++;
+    return;
+  }
+  //Big endian loads swap the word back, the first pixel is in the low bits either way
+  if (this->load_swap_)
+    word = (word << 8) | (word >> 8);
+  const uint8_t bits = this->load_bits_ == 3 ? 4 : this->load_bits_;
+  const uint16_t mask = (1 << bits) - 1;
+  for (uint8_t shift = 0; shift < 16; shift += bits) {
+    const uint8_t value = (word >> shift) & mask;
+    if (this->load_col_ < this->load_w_)
+      this->load_pixel_(bits == 8 ? value : bits == 4 ? value * 0x11 : value * 0x55);
+    this->load_col_++;
+  }
+  //Rows start on a word boundary
+  if (this->load_col_ >= this->load_w_) {
+    this->load_col_ = 0;
+    this->load_row_++;
+  }
+}
+
+void Controller::load_pixel_(uint8_t gray) {
+  const int hx = this->load_x_ + this->load_col_, hy = this->load_y_ + this->load_row_;
+  int px = hx, py = hy;
+  switch (this->load_rotate_) {
+    case 1:
+      px = this->width_ - 1 - hy;
+      py = hx;
+      break;
+    case 2:
+      px = this->width_ - 1 - hx;
+      py = this->height_ - 1 - hy;
+      break;
+    case 3:
+      px = hy;
+      py = this->height_ - 1 - hx;
+      break;
+    default:
+      break;
+  }
+  if (px < 0 || py < 0 || px >= this->width_ || py >= this->height_) {
+    this->bus_errors_++;
+    return;
+  }
+  this->set_mem_(this->load_base_ + (uint32_t) py * this->width_ + px, gray);
+}
+
+//-----------------------------------------------------------
+// Display engines
+//-----------------------------------------------------------
+uint32_t Controller::lut_duration_ms_(uint16_t mode) {
+  const uint16_t a2 = this->lut_version_.compare(0, 4, "M641") == 0 ? 4 : 6;
+  if (mode == a2)
+    return 120;
+  switch (mode) {
+    case 0:
+      return 2000;
+    case 1:
+      return 260;
+    default:
+      return 450;
+  }
+}
+
+uint8_t Controller::read_image_(uint32_t addr, uint16_t x, uint16_t y) {
+  //1bpp mode expands every bit through BGVR, 1 is the low byte
+  if (this->registers_[REG_UP1SR + 2] & (1 << 2)) {
+    const uint8_t bits = this->mem_(addr + (uint32_t) y * this->width_ + x / 8);
+    const uint16_t bgvr = this->registers_[REG_BGVR];
+    return (bits >> (x % 8)) & 1 ? bgvr & 0xFF : bgvr >> 8;
+  }
+  return this->mem_(addr + (uint32_t) y * this->width_ + x);
+}
+
+void Controller::display_(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t mode, uint32_t addr) {
+  if (w == 0 || h == 0 || x + w > this->width_ || y + h > this->height_) {
+    this->bus_errors_++;
+    return;
+  }
+  const uint16_t a2 = this->lut_version_.compare(0, 4, "M641") == 0 ? 4 : 6;
+  auto binary = [](uint8_t gray) { return (gray >> 4) == 0x0 || (gray >> 4) == 0xF; };
+  bool artifact = false;
+  for (uint16_t j = y; j < y + h; j++) {
+    for (uint16_t i = x; i < x + w; i++) {
+      uint8_t &pixel = this->panel_[(uint32_t) j * this->width_ + i];
+      const uint8_t gray = this->read_image_(addr, i, j);
+      if ((mode == a2 && (!binary(pixel) || !binary(gray))) || (mode == 1 && !binary(gray)))
+        artifact = true;
+      pixel = gray;
+    }
+  }
+  if (artifact)
+    this->artifacts_++;
+
+  //A free engine starts right away, otherwise the refresh waits for the first one to finish
+  const uint64_t now = now_us();
+  uint8_t engine = 0;
+  for (uint8_t i = 0; i < 16; i++) {
+    if (this->engine_end_[i] <= now) {
+      engine = i;
+      break;
+    }
+    if (this->engine_end_[i] < this->engine_end_[engine])
+      engine = i;
+  }
+  const uint64_t start = std::max(now, this->engine_end_[engine]);
+  this->engine_end_[engine] = start + (uint64_t) this->lut_duration_ms_(mode) * 1000;
+  this->engine_area_[engine] = {x, y, (uint16_t) (x + w - 1), (uint16_t) (y + h - 1)};
+  this->refreshes_.push_back({x, y, w, h, mode, addr, engine, start, this->engine_end_[engine]});
+}
+
+bool Controller::overlaps_busy_(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1) {
+  const uint64_t now = now_us();
+  for (uint8_t i = 0; i < 16; i++) {
+    const EngineArea &area = this->engine_area_[i];
+    if (this->engine_end_[i] > now && !(x0 > area.x1 || x1 < area.x0 || y0 > area.y1 || y1 < area.y0))
+      return true;
+  }
+  return false;
+}
+
+uint8_t Controller::mem_(uint32_t addr) {
+  if (addr >= this->memory_.size()) {
+    this->bus_errors_++;
+    return 0;
+  }
+  return this->memory_[addr];
+}
+
+void Controller::set_mem_(uint32_t addr, uint8_t value) {
+  if (addr >= this->memory_.size()) {
+    this->bus_errors_++;
+    return;
+  }
+  this->memory_[addr] = value;
+}
+
+//-----------------------------------------------------------
+// Inspection
+//-----------------------------------------------------------
+uint8_t Controller::panel(uint16_t x, uint16_t y) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->panel_[(uint32_t) y * this->width_ + x];
+}
+
+uint8_t Controller::image(uint16_t x, uint16_t y) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->read_image_(IMAGE_ADDR, x, y);
+}
+
+uint16_t Controller::busy_engines() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  const uint64_t now = now_us();
+  uint16_t mask = 0;
+  for (uint8_t i = 0; i < 16; i++) {
+    if (this->engine_end_[i] > now)
+      mask |= 1 << i;
+  }
+  return mask;
+}
+
+uint16_t Controller::get_register(uint16_t addr) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  if (addr == REG_LUTAFSR)
+    return this->busy_engines();
+  auto it = this->registers_.find(addr);
+  return it == this->registers_.end() ? 0 : it->second;
+}
+
+BusStats Controller::get_stats() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->stats_;
+}
+
+void Controller::reset_stats() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  this->stats_ = {};
+  this->command_counts_.clear();
+}
+
+std::vector<Refresh> Controller::get_refreshes() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->refreshes_;
+}
+
+void Controller::clear_refreshes() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  this->refreshes_.clear();
+}
+
+uint32_t Controller::get_command_count(uint16_t code) {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  auto it = this->command_counts_.find(code);
+  return it == this->command_counts_.end() ? 0 : it->second;
+}
+
+std::set<std::thread::id> Controller::get_load_threads() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->load_threads_;
+}
+
+uint16_t Controller::get_power_state() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->power_state_;
+}
+
+uint32_t Controller::get_handshake_violations() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->handshake_violations_;
+}
+
+uint32_t Controller::get_load_violations() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->load_violations_;
+}
+
+uint32_t Controller::get_bus_errors() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->bus_errors_;
+}
+
+uint32_t Controller::get_artifacts() {
+  std::lock_guard<std::recursive_mutex> lock(this->mutex_);
+  return this->artifacts_;
+}
+
+}  // namespace it8951_sim
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "esphome/components/spi/spi.h"
+#include "esphome/core/gpio.h"
+
+// Simulated IT8951 behind the SPI host interface, for running the driver on Linux.
+//
+// Every transaction starts with a preamble word: 0x6000 command, 0x0000 write data, 0x1000 read
+// data. Words go MSB first. A read returns two dummy bytes, then words. The controller model keeps
+// a register map, 8bpp image memory with the panel's row stride, and the panel itself, which gets
+// the image buffer copied in when a display command is issued. LUT engines take a fixed time per
+// waveform and show up in LUTAFSR while they run.
+//
+// HRDY drops after every preamble, command and argument word. Sending another preamble, command or
+// argument while it is low counts as a handshake violation. Pixel and memory burst data have a FIFO
+// on the real chip and are exempt.
+//
+// Time is the virtual clock from host/hal.cpp. Every byte on the bus advances it by its wire time
+// at the clock the device was registered with, reading HRDY advances it by a microsecond.
+
+namespace it8951_sim {
+
+/// Display command as the controller received it.
+struct Refresh {
+  uint16_t x;
+  uint16_t y;
+  uint16_t w;
+  uint16_t h;
+  uint16_t mode;
+  uint32_t addr;
+  uint8_t engine;
+  uint64_t start_us;
+  uint64_t end_us;
+};
+
+/// Traffic seen on the bus.
+struct BusStats {
+  uint32_t transactions{0};
+  uint32_t command_transactions{0};
+  uint32_t write_transactions{0};
+  uint32_t read_transactions{0};
+  uint64_t bytes{0};
+  /// Time the bytes took on the wire.
+  double wire_us{0};
+  uint32_t device_setups{0};
+  /// Clock the last read transaction ran at.
+  uint32_t read_data_rate{0};
+};
+
+class Controller;
+
+class HrdyPin : public esphome::InternalGPIOPin {
+ public:
+  explicit HrdyPin(Controller *controller) : controller_(controller) {}
+  bool digital_read() override;
+
+ protected:
+  Controller *controller_;
+};
+
+class Controller : public esphome::spi::SPIComponent {
+ public:
+  static const uint32_t IMAGE_ADDR = 0x1236E0;
+
+  Controller(uint16_t width, uint16_t height, const char *lut_version = "M841_TFA2812");
+
+  esphome::InternalGPIOPin *get_hrdy_pin() { return &this->hrdy_pin_; }
+
+  void register_device(esphome::spi::SPIClient *device, uint32_t data_rate) override;
+  void unregister_device(esphome::spi::SPIClient *device) override;
+  void begin_transaction(esphome::spi::SPIClient *device) override;
+  uint8_t transfer(uint8_t data) override;
+  void end_transaction(esphome::spi::SPIClient *device) override;
+
+  bool is_ready();
+
+  uint16_t get_width() const { return this->width_; }
+  uint16_t get_height() const { return this->height_; }
+  /// 8 bit gray the panel shows, 0x00 is black.
+  uint8_t panel(uint16_t x, uint16_t y);
+  /// 8 bit gray in the displayed image buffer.
+  uint8_t image(uint16_t x, uint16_t y);
+  uint16_t get_register(uint16_t addr);
+  /// LUT engines busy right now, as LUTAFSR reads.
+  uint16_t busy_engines();
+
+  BusStats get_stats();
+  void reset_stats();
+  std::vector<Refresh> get_refreshes();
+  void clear_refreshes();
+  uint32_t get_command_count(uint16_t code);
+  /// Threads that sent image loads.
+  std::set<std::thread::id> get_load_threads();
+  /// Power state the last SYS_RUN, STANDBY or SLEEP put the controller in.
+  uint16_t get_power_state();
+
+  /// Preamble, command or argument words sent while HRDY was low.
+  uint32_t get_handshake_violations();
+  /// Loads into the displayed image over an area a LUT engine is still refreshing.
+  uint32_t get_load_violations();
+  /// Malformed transactions: unknown preamble or command, CS asserted twice, unregistered device, ...
+  uint32_t get_bus_errors();
+  /// A2 refreshes with gray before or after and DU refreshes with gray after, per refresh.
+  uint32_t get_artifacts();
+
+ protected:
+  enum Mode : uint8_t { MODE_IDLE, MODE_COMMAND, MODE_WRITE, MODE_READ };
+
+  void check_ready_();
+  void busy_for_(uint32_t us);
+  void receive_command_(uint16_t code);
+  void data_word_(uint16_t word);
+  void execute_();
+  void load_start_(uint16_t arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+  void load_word_(uint16_t word);
+  void load_pixel_(uint8_t gray);
+  void display_(uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint16_t mode, uint32_t addr);
+  uint8_t read_image_(uint32_t addr, uint16_t x, uint16_t y);
+  uint32_t lut_duration_ms_(uint16_t mode);
+  uint8_t mem_(uint32_t addr);
+  void set_mem_(uint32_t addr, uint8_t value);
+  bool overlaps_busy_(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
+
+  std::recursive_mutex mutex_;
+  HrdyPin hrdy_pin_;
+  uint16_t width_;
+  uint16_t height_;
+  std::string lut_version_;
+  std::vector<uint8_t> memory_;
+  std::vector<uint8_t> panel_;
+  std::map<uint16_t, uint16_t> registers_;
+  uint16_t power_state_{1};
+
+  std::map<esphome::spi::SPIClient *, uint32_t> devices_;
+  esphome::spi::SPIClient *active_{nullptr};
+  double byte_us_{0};
+  double wire_debt_us_{0};
+  uint64_t ready_at_{0};
+
+  Mode mode_{MODE_IDLE};
+  uint32_t byte_index_{0};
+  uint16_t word_{0};
+  uint16_t preamble_{0};
+  std::deque<uint16_t> read_queue_;
+
+  /// Command waiting for its arguments.
+  uint16_t command_{0};
+  uint8_t args_needed_{0};
+  std::vector<uint16_t> args_;
+
+  /// LD_IMG(_AREA) in progress.
+  bool loading_{false};
+  bool load_swap_{false};
+  uint8_t load_bits_{4};
+  uint16_t load_rotate_{0};
+  uint16_t load_x_{0};
+  uint16_t load_y_{0};
+  uint16_t load_w_{0};
+  uint16_t load_h_{0};
+  uint32_t load_base_{0};
+  uint32_t load_col_{0};
+  uint32_t load_row_{0};
+
+  /// MEM_BST_WR in progress and the MEM_BST_RD_T request.
+  bool burst_writing_{false};
+  uint32_t burst_addr_{0};
+  uint32_t burst_read_addr_{0};
+  uint32_t burst_read_count_{0};
+
+  uint64_t engine_end_[16]{};
+  struct EngineArea {
+    uint16_t x0, y0, x1, y1;
+  } engine_area_[16]{};
+
+  BusStats stats_;
+  std::vector<Refresh> refreshes_;
+  std::map<uint16_t, uint32_t> command_counts_;
+  std::set<std::thread::id> load_threads_;
+  uint32_t handshake_violations_{0};
+  uint32_t load_violations_{0};
+  uint32_t bus_errors_{0};
+  uint32_t artifacts_{0};
+};
+
+}  // namespace it8951_sim
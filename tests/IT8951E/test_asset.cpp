@@ -0,0 +1,185 @@
+#include "test_display.h"
+
+#include <vector>
+
+#include "esphome/core/hal.h"
+
+// Flash assets are streamed into image memory on top of the frame and kept out of frame uploads.
+
+using esphome::display::DisplayRotation;
+using esphome::it8951e::IT8951Asset;
+using esphome::it8951e::it8951e;
+
+static const int ASSET_W = 6;
+static const int ASSET_H = 4;
+
+/// Row 2 is white, so a run of white covers the padding at the end of row 1 and all of row 2.
+static uint8_t asset_gray(int x, int y) { return y == 2 ? 0xF : (x + 3 * y) % 16; }
+
+/// Packed and RLE compressed like display.py does: rows padded to 4 pixels with white.
+static std::vector<uint8_t> encode_asset() {
+  std::vector<uint8_t> raw;
+  for (int y = 0; y < ASSET_H; y++) {
+    for (int x = 0; x < 8; x += 2) {
+      const uint8_t lo = x < ASSET_W ? asset_gray(x, y) : 0xF;
+      const uint8_t hi = x + 1 < ASSET_W ? asset_gray(x + 1, y) : 0xF;
+      raw.push_back(lo | (hi << 4));
+    }
+  }
+  std::vector<uint8_t> out;
+  size_t i = 0;
+  while (i < raw.size()) {
+    size_t run = 1;
+    while (i + run < raw.size() && raw[i + run] == raw[i])
+      run++;
+    if (run >= 3) {
+      out.push_back(0x80 | (run - 1));
+      out.push_back(raw[i]);
+      i += run;
+      continue;
+    }
+    //Literals up to the next run
+    size_t start = i;
+    while (i < raw.size() && !(i + 2 < raw.size() && raw[i] == raw[i + 1] && raw[i] == raw[i + 2]))
+      i++;
+    out.push_back(i - start - 1);
+    out.insert(out.end(), raw.begin() + start, raw.begin() + i);
+  }
+  return out;
+}
+
+static const uint16_t LD_IMG_AREA = 0x0021;
+
+/// Compares the panel with what the writer of test_asset() draws, with the asset at (ax, ay) and white padding.
+static uint32_t asset_mismatches(it8951_sim::Controller &sim, int ax, int ay, int frame, DisplayRotation rotation) {
+  const bool turned = rotation == esphome::display::DISPLAY_ROTATION_90_DEGREES;
+  const int w = sim.get_width();
+  const int hw = turned ? sim.get_height() : w, hh = turned ? w : sim.get_height();
+  uint32_t mismatches = 0;
+  for (int hy = 0; hy < hh; hy++) {
+    for (int hx = 0; hx < hw; hx++) {
+      const int px = turned ? w - 1 - hy : hx, py = turned ? hx : hy;
+      uint8_t expected = hx >= 160 && hx < 168 && hy >= 100 && hy < 108 + frame * 8 ? 0xFF : 0x00;
+      if (hx >= ax && hx < ax + 8 && hy >= ay && hy < ay + ASSET_H)
+        expected = hx - ax < ASSET_W ? asset_gray(hx - ax, hy - ay) * 0x11 : 0xFF;
+      if (sim.panel(px, py) != expected)
+        mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+static void test_asset(int x, int y, uint8_t bits_per_pixel, uint16_t band_height, DisplayRotation rotation) {
+  it8951_sim::Controller sim(256, 192);
+  static const std::vector<uint8_t> data = encode_asset();
+  static const IT8951Asset asset(data.data(), data.size(), ASSET_W, ASSET_H);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_bits_per_pixel(bits_per_pixel);
+    it.set_band_height(band_height);
+    it.set_rotation(rotation);
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_ON);
+      //Under the asset, never sent
+      it.filled_rectangle(x, y, ASSET_W, ASSET_H, esphome::display::COLOR_OFF);
+      it.filled_rectangle(160, 100, 8, 8 + frame * 8, esphome::display::COLOR_OFF);
+      CHECK(it.draw_asset(x, y, &asset));
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(asset_mismatches(sim, x, y, frame, rotation), 0);
+
+  //The second frame changes elsewhere, the asset is neither sent again nor overwritten
+  frame = 1;
+  sim.reset_stats();
+  sim.clear_refreshes();
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  if (band_height == 0)
+    CHECK_EQ(sim.get_command_count(LD_IMG_AREA), 1);
+  CHECK_EQ(sim.get_refreshes().size(), 1);
+  CHECK_EQ(asset_mismatches(sim, x, y, frame, rotation), 0);
+  CHECK_EQ(sim.get_artifacts(), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+static void test_rejected(int x, int y, uint8_t bits_per_pixel) {
+  it8951_sim::Controller sim(256, 192);
+  static const std::vector<uint8_t> data = encode_asset();
+  static const IT8951Asset asset(data.data(), data.size(), ASSET_W, ASSET_H);
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_bits_per_pixel(bits_per_pixel);
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_ON);
+      CHECK(!it.draw_asset(x, y, &asset));
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+}
+
+/// Once the writer stops drawing it, the frame underneath comes back.
+static void test_dropped(uint16_t band_height) {
+  it8951_sim::Controller sim(256, 192);
+  static const std::vector<uint8_t> data = encode_asset();
+  static const IT8951Asset asset(data.data(), data.size(), ASSET_W, ASSET_H);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_band_height(band_height);
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_ON);
+      it.filled_rectangle(40, 20, 2, 2, esphome::display::COLOR_OFF);
+      if (frame == 0)
+        CHECK(it.draw_asset(36, 20, &asset));
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  frame = 1;
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  for (int j = 0; j < ASSET_H; j++) {
+    for (int i = 0; i < 8; i++)
+      CHECK_EQ(sim.panel(36 + i, 20 + j), i >= 4 && i < 6 && j < 2 ? 0xFF : 0x00);
+  }
+  CHECK_EQ(sim.get_artifacts(), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+/// Data that ends early reads as white from there on.
+static void test_truncated() {
+  it8951_sim::Controller sim(256, 192);
+  static const std::vector<uint8_t> data = encode_asset();
+  //Up to and including the control byte of a literal run, without its bytes
+  static const IT8951Asset asset(data.data(), 1, ASSET_W, ASSET_H);
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      CHECK(it.draw_asset(36, 20, &asset));
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  for (int j = 0; j < ASSET_H; j++) {
+    for (int i = 0; i < 8; i++)
+      CHECK_EQ(sim.panel(36 + i, 20 + j), 0xFF);
+  }
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+int main() {
+  test_asset(36, 20, 4, 0, esphome::display::DISPLAY_ROTATION_0_DEGREES);
+  test_asset(36, 6, 4, 8, esphome::display::DISPLAY_ROTATION_0_DEGREES);
+  test_asset(40, 20, 2, 0, esphome::display::DISPLAY_ROTATION_0_DEGREES);
+  test_asset(36, 20, 4, 0, esphome::display::DISPLAY_ROTATION_90_DEGREES);
+  test_rejected(36, 20, 1);
+  test_rejected(37, 20, 4);
+  test_rejected(252, 20, 4);
+  test_dropped(0);
+  test_dropped(8);
+  test_truncated();
+  printf("%s: %d failures\n", __FILE__, test_failures);
+  return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#include "test_display.h"
+
+#include "esphome/core/hal.h"
+
+// Images kept in controller memory and shown with DPY_BUF_AREA on top of the frame.
+
+using esphome::Color;
+using esphome::it8951e::it8951e;
+
+static const uint16_t DPY_BUF_AREA = 0x0037;
+static const uint16_t MODE_DU = 1;
+
+static void test_blits_follow_writer() {
+  it8951_sim::Controller sim(256, 192);
+  bool show = false, box = false;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      it.filled_rectangle(0, 0, 32, 32, esphome::display::COLOR_ON);
+      if (box)
+        it.filled_rectangle(80, 60, 40, 20, Color(127, 127, 127));
+      if (show)
+        it.show_cached("icon", 96, 64);
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK(display->cache_region("icon", 0, 0, 32, 32));
+
+  //Shown once, black and white only so with DU
+  show = true;
+  sim.clear_refreshes();
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(sim.get_command_count(DPY_BUF_AREA), 1);
+  CHECK_EQ(sim.get_refreshes().size(), 1);
+  CHECK_EQ(sim.get_refreshes().back().mode, MODE_DU);
+  CHECK_EQ(sim.panel(100, 70), 0x00);
+
+  //Nothing changed, nothing is refreshed
+  sim.clear_refreshes();
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(sim.get_refreshes().size(), 0);
+  CHECK_EQ(sim.get_command_count(DPY_BUF_AREA), 1);
+
+  //A refresh of the frame underneath would wipe it, it is shown again on top
+  box = true;
+  sim.clear_refreshes();
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(sim.get_command_count(DPY_BUF_AREA), 2);
+  CHECK_EQ(sim.panel(100, 70), 0x00);
+  CHECK_EQ(sim.panel(85, 62), display->frame_gray(85, 62));
+
+  //Once the writer stops showing it the frame comes back
+  show = false;
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(display->cached_blits_.size(), 0);
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.get_artifacts(), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+int main() {
+  test_blits_follow_writer();
+  printf("%s: %d failures\n", __FILE__, test_failures);
+  return test_failures == 0 ? 0 : 1;
+}
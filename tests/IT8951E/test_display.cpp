@@ -0,0 +1,68 @@
+#include "test_display.h"
+
+#include "esphome/core/hal.h"
+
+int test_failures = 0;
+
+std::unique_ptr<TestDisplay> make_display(it8951_sim::Controller &sim,
+                                          const std::function<void(TestDisplay &)> &configure) {
+  //Deleting it joins the pipeline thread of a double buffered display
+  auto display = std::make_unique<TestDisplay>();
+  display->set_spi_parent(&sim);
+  display->set_busy_pin(sim.get_hrdy_pin());
+  display->set_data_rate(esphome::spi::DATA_RATE_20MHZ);
+  if (configure)
+    configure(*display);
+  display->setup();
+  return display;
+}
+
+void run_for(TestDisplay *display, uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    display->loop();
+    esphome::delay(1);
+  }
+}
+
+bool run_until_idle(TestDisplay *display, uint32_t timeout_ms) {
+  for (uint32_t i = 0; i < timeout_ms; i++) {
+    display->loop();
+    if (display->idle())
+      return true;
+    esphome::delay(1);
+  }
+  return false;
+}
+
+uint32_t panel_mismatches(it8951_sim::Controller &sim, TestDisplay *display,
+                          esphome::display::DisplayRotation rotation) {
+  const int w = sim.get_width(), h = sim.get_height();
+  const bool turned = rotation == esphome::display::DISPLAY_ROTATION_90_DEGREES ||
+                      rotation == esphome::display::DISPLAY_ROTATION_270_DEGREES;
+  const int hw = turned ? h : w, hh = turned ? w : h;
+  uint32_t mismatches = 0;
+  for (int hy = 0; hy < hh; hy++) {
+    for (int hx = 0; hx < hw; hx++) {
+      int px = hx, py = hy;
+      switch (rotation) {
+        case esphome::display::DISPLAY_ROTATION_90_DEGREES:
+          px = w - 1 - hy;
+          py = hx;
+          break;
+        case esphome::display::DISPLAY_ROTATION_180_DEGREES:
+          px = w - 1 - hx;
+          py = h - 1 - hy;
+          break;
+        case esphome::display::DISPLAY_ROTATION_270_DEGREES:
+          px = hy;
+          py = h - 1 - hx;
+          break;
+        default:
+          break;
+      }
+      if (sim.panel(px, py) != display->frame_gray(hx, hy))
+        mismatches++;
+    }
+  }
+  return mismatches;
+}
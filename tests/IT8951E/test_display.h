@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+
+#include "IT8951E/IT8951E.h"
+#include "it8951_sim.h"
+
+// Shared by the host tests and the benchmark: the driver wired to a simulated controller.
+
+/// Counts failed checks instead of stopping at the first one.
+extern int test_failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    const long long check_a = (long long) (a), check_b = (long long) (b); \
+    if (check_a != check_b) { \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, check_a, check_b); \
+      test_failures++; \
+    } \
+  } while (0)
+
+/// Opens the driver's internals to the tests.
+class TestDisplay : public esphome::it8951e::it8951e {
+ public:
+  using it8951e::buffer_;
+  using it8951e::cached_blits_;
+  using it8951e::display_frame_;
+  using it8951e::dirty_count_;
+  using it8951e::flush_commands_;
+  using it8951e::frame_pending_;
+  using it8951e::gray_tiles_;
+  using it8951e::inflight_count_;
+  using it8951e::IT8951ReadReg;
+  using it8951e::IT8951WriteReg;
+  using it8951e::lut_busy_;
+  using it8951e::lut_summary_;
+  using it8951e::pipeline_busy_;
+  using it8951e::pitch_;
+  using it8951e::select_waveform_;
+  using it8951e::tiles_x_;
+  using it8951e::update_requested_;
+
+  /// 8 bit gray the frame buffer holds at host pixel (x, y), as the controller should show it.
+  uint8_t frame_gray(int x, int y) {
+    const uint8_t *row = this->buffer_ + y * this->pitch_;
+    switch (this->bits_per_pixel_) {
+      case 1:
+        return (row[x / 8] >> (x % 8)) & 1 ? 0xF0 : 0x00;
+      case 2:
+        return ((row[x / 4] >> ((x % 4) * 2)) & 0x3) * 0x55;
+      case 4:
+        return ((row[x / 2] >> ((x % 2) * 4)) & 0xF) * 0x11;
+      default:
+        return row[x];
+    }
+  }
+
+  bool idle() { return !this->lut_busy_ && !this->frame_pending_ && !this->pipeline_busy_ && !this->update_requested_; }
+};
+
+/// Driver at 4bpp and 20 MHz on the given simulator, configure runs before setup().
+/// Declare it after the simulator, so it is gone before the simulator is.
+std::unique_ptr<TestDisplay> make_display(it8951_sim::Controller &sim, const std::function<void(TestDisplay &)> &configure = nullptr);
+
+/// Calls loop() every simulated millisecond for ms milliseconds.
+void run_for(TestDisplay *display, uint32_t ms);
+
+/// Calls loop() until the display has sent everything and the LUT engines are done, false on timeout.
+bool run_until_idle(TestDisplay *display, uint32_t timeout_ms = 10000);
+
+/// Host pixels that differ between the frame buffer and the panel, rotation as configured.
+uint32_t panel_mismatches(it8951_sim::Controller &sim, TestDisplay *display, esphome::display::DisplayRotation rotation =
+                                                                                 esphome::display::DISPLAY_ROTATION_0_DEGREES);
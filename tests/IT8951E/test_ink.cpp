@@ -0,0 +1,100 @@
+#include "test_display.h"
+
+#include "esphome/core/hal.h"
+
+// Ink: touches drawn into the frame and refreshed from loop(), with a stand-in for the GT911.
+
+using esphome::display::DisplayRotation;
+using esphome::gt911::GT911;
+using esphome::gt911::TP_Point;
+using esphome::it8951e::it8951e;
+
+namespace esphome {
+namespace gt911 {
+
+/// What the display registered, the tests call it with their own touch reports.
+static std::function<void(const TP_Point *, uint8_t)> touch_callback;
+
+TP_Point::TP_Point() : id(0), x(0), y(0), size(0) {}
+TP_Point::TP_Point(uint8_t id, uint16_t x, uint16_t y, uint16_t size) : id(id), x(x), y(y), size(size) {}
+void GT911::setup() {}
+void GT911::update() {}
+void GT911::loop() {}
+void GT911::dump_config() {}
+void GT911::add_touch_callback(std::function<void(const TP_Point *, uint8_t)> &&callback) {
+  touch_callback = std::move(callback);
+}
+
+}  // namespace gt911
+}  // namespace esphome
+
+static void touch(int x, int y) {
+  const TP_Point point(0, x, y, 10);
+  esphome::gt911::touch_callback(&point, 1);
+  esphome::gt911::touch_callback(nullptr, 0);
+}
+
+static void test_stroke_erased_by_update() {
+  it8951_sim::Controller sim(256, 192);
+  static GT911 touchscreen;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_ink_touchscreen(&touchscreen);
+    it.set_auto_clear(false);
+    it.set_writer([](it8951e &it) { it.fill(esphome::display::COLOR_OFF); });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+
+  touch(50, 50);
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(sim.panel(50, 50), 0x00);
+
+  //The writer draws the same frame as before the stroke, the frame diff must not skip the stroke's tiles
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(sim.panel(50, 50), 0xFF);
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.get_artifacts(), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+/// Without auto clear a writer that leaves the stroke alone keeps it, the touch is in panel coordinates.
+static void test_stroke_kept(DisplayRotation rotation) {
+  it8951_sim::Controller sim(256, 192);
+  static GT911 touchscreen;
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_ink_touchscreen(&touchscreen);
+    it.set_rotation(rotation);
+    it.set_auto_clear(false);
+    it.set_writer([&](it8951e &it) {
+      if (frame == 0)
+        it.fill(esphome::display::COLOR_OFF);
+      it.filled_rectangle(0, 0, 8, 8, frame % 2 ? esphome::display::COLOR_ON : esphome::display::COLOR_OFF);
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+
+  touch(60, 40);
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(sim.panel(60, 40), 0x00);
+  CHECK_EQ(sim.panel(40, 60), 0xFF);
+
+  frame = 1;
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(sim.panel(60, 40), 0x00);
+  CHECK_EQ(panel_mismatches(sim, display.get(), rotation), 0);
+  CHECK_EQ(sim.get_artifacts(), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+int main() {
+  test_stroke_erased_by_update();
+  test_stroke_kept(esphome::display::DISPLAY_ROTATION_0_DEGREES);
+  test_stroke_kept(esphome::display::DISPLAY_ROTATION_90_DEGREES);
+  test_stroke_kept(esphome::display::DISPLAY_ROTATION_270_DEGREES);
+  printf("%s: %d failures\n", __FILE__, test_failures);
+  return test_failures == 0 ? 0 : 1;
+}
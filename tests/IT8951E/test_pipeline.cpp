@@ -0,0 +1,88 @@
+#include "test_display.h"
+
+#include <thread>
+
+#include "esphome/core/hal.h"
+
+// Double buffering: the pipeline thread sends frames and waits for the LUT engines itself.
+
+using esphome::Color;
+using esphome::it8951e::it8951e;
+
+static const uint16_t STANDBY = 0x0002;
+static const uint16_t MODE_GC16 = 2;
+static const uint16_t MODE_DU = 1;
+
+static void test_frames_retire() {
+  it8951_sim::Controller sim(256, 192);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_double_buffer(true);
+    it.set_idle_standby(true);
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      const uint8_t v = 255 - (60 + frame * 30);
+      it.filled_rectangle(16 + frame * 24, 40, 20, 20, Color(v, v, v));
+    });
+  });
+  for (frame = 0; frame < 5; frame++) {
+    display->update();
+    CHECK(run_until_idle(display.get()));
+    CHECK(!display->lut_busy_);
+    CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  }
+  //loop() publishes the LUT time of every frame once the task saw the engines go idle
+  run_for(display.get(), 2);
+  CHECK_EQ(display->lut_summary_.count, 5);
+  CHECK(sim.get_command_count(STANDBY) >= 5);
+  CHECK_EQ(sim.get_power_state(), STANDBY);
+
+  const auto threads = sim.get_load_threads();
+  CHECK_EQ(threads.size(), 1);
+  CHECK(threads.count(std::this_thread::get_id()) == 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+  CHECK_EQ(sim.get_load_violations(), 0);
+}
+
+static void test_cleanup_runs() {
+  it8951_sim::Controller sim(256, 192);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_double_buffer(true);
+    it.set_cleanup_threshold(2);
+    it.set_cleanup_delay(100);
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      if (frame % 2 == 1)
+        it.filled_rectangle(64, 64, 16, 16, esphome::display::COLOR_ON);
+    });
+  });
+  for (frame = 0; frame < 3; frame++) {
+    display->update();
+    CHECK(run_until_idle(display.get()));
+  }
+  run_for(display.get(), 500);
+  CHECK(run_until_idle(display.get()));
+
+  //Full GC16, the box on and off with DU, then a GC16 of the box alone once the display is idle
+  const auto refreshes = sim.get_refreshes();
+  CHECK_EQ(refreshes.size(), 4);
+  if (refreshes.size() == 4) {
+    CHECK_EQ(refreshes[1].mode, MODE_DU);
+    CHECK_EQ(refreshes[2].mode, MODE_DU);
+    CHECK_EQ(refreshes[3].mode, MODE_GC16);
+    CHECK(refreshes[3].x <= 64 && refreshes[3].x + refreshes[3].w >= 80);
+    CHECK(refreshes[3].y <= 64 && refreshes[3].y + refreshes[3].h >= 80);
+    CHECK(refreshes[3].w < 256);
+  }
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+  CHECK_EQ(sim.get_load_violations(), 0);
+}
+
+int main() {
+  test_frames_retire();
+  test_cleanup_runs();
+  printf("%s: %d failures\n", __FILE__, test_failures);
+  return test_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+#include "test_display.h"
+
+#include "esphome/core/hal.h"
+
+// Frames go over the simulated SPI bus and are rebuilt from what the controller received.
+
+using esphome::Color;
+using esphome::display::DisplayRotation;
+using esphome::it8951e::it8951e;
+
+static const uint16_t PANEL_W = 256;
+static const uint16_t PANEL_H = 192;
+
+static const uint16_t I80CPCR = 0x0004;
+static const uint16_t LISAR = 0x0208;
+static const uint16_t REG_WR = 0x0011;
+static const uint16_t DPY_AREA = 0x0034;
+
+/// Gray levels in every corner, a black box and a gradient.
+static void draw_test_pattern(it8951e &it) {
+  it.fill(esphome::display::COLOR_OFF);
+  it.filled_rectangle(10, 10, 40, 20, esphome::display::COLOR_ON);
+  for (int i = 0; i < 16; i++) {
+    //Gray as RGB goes by luma, RGB black would be COLOR_OFF
+    const uint8_t v = 255 - i * 17;
+    it.filled_rectangle(60 + i * 8, 40, 8, 30, i < 15 ? Color(v, v, v) : esphome::display::COLOR_ON);
+  }
+  it.rectangle(0, 0, it.get_width(), it.get_height(), esphome::display::COLOR_ON);
+  it.draw_pixel_at(3, 5, Color(127, 127, 127));
+}
+
+static void test_init() {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  auto display = make_display(sim);
+  CHECK_EQ(display->get_width(), PANEL_W);
+  CHECK_EQ(display->get_height(), PANEL_H);
+  CHECK_EQ(sim.get_register(I80CPCR), 0x0001);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+static void test_full_update(uint8_t bits_per_pixel) {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_bits_per_pixel(bits_per_pixel);
+    it.set_writer(draw_test_pattern);
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.panel(20, 20), 0x00);
+  CHECK_EQ(sim.panel(PANEL_W / 2, PANEL_H - 20), bits_per_pixel == 1 ? 0xF0 : 0xFF);
+  const auto refreshes = sim.get_refreshes();
+  CHECK(!refreshes.empty());
+  if (!refreshes.empty()) {
+    CHECK_EQ(refreshes.back().w, PANEL_W);
+    CHECK_EQ(refreshes.back().h, PANEL_H);
+  }
+  CHECK_EQ(sim.get_handshake_violations(), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+  CHECK_EQ(sim.get_load_violations(), 0);
+}
+
+static void test_partial_update(uint16_t band_height = 0, uint32_t tile_pool_size = 0) {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_band_height(band_height);
+    it.set_tile_pool_size(tile_pool_size);
+    it.set_writer([&](it8951e &it) {
+      draw_test_pattern(it);
+      if (frame > 0)
+        it.filled_rectangle(100, 100, 16, 16, Color(255 - frame * 60, 255 - frame * 60, 255 - frame * 60));
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  const uint64_t full_bytes = sim.get_stats().bytes;
+
+  for (frame = 1; frame <= 3; frame++) {
+    sim.reset_stats();
+    sim.clear_refreshes();
+    display->update();
+    CHECK(run_until_idle(display.get()));
+    if (band_height == 0)
+      CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+    CHECK_EQ(sim.panel(108, 108), (255 - frame * 60 + 8) / 17 * 0x11);
+    //Only the box is sent and refreshed, LISAR already points at the image buffer.
+    //Banded, auto clear and the writer's fill() only clear the strip being drawn.
+    const auto refreshes = sim.get_refreshes();
+    CHECK_EQ(refreshes.size(), 1);
+    if (!refreshes.empty()) {
+      CHECK(refreshes[0].x <= 100 && refreshes[0].x + refreshes[0].w >= 116);
+      CHECK(refreshes[0].w <= 64 && refreshes[0].h <= 64);
+    }
+    CHECK(sim.get_stats().bytes * 10 < full_bytes);
+    CHECK_EQ(sim.get_command_count(REG_WR), 0);
+  }
+  CHECK_EQ(sim.get_handshake_violations(), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+  CHECK_EQ(sim.get_load_violations(), 0);
+}
+
+/// The tile pool keeps the frame, without auto clear the writer only draws what changed.
+static void test_tiles_kept(bool frame_diff) {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_tile_pool_size(32768);
+    it.set_frame_diff(frame_diff);
+    it.set_auto_clear(false);
+    it.set_writer([&](it8951e &it) {
+      if (frame == 0)
+        draw_test_pattern(it);
+      it.filled_rectangle(100 + frame * 8, 100, 8, 8, esphome::display::COLOR_ON);
+    });
+  });
+  for (frame = 0; frame < 3; frame++) {
+    sim.clear_refreshes();
+    display->update();
+    CHECK(run_until_idle(display.get()));
+  }
+  //Only the box of the last frame is refreshed, the pattern and the earlier boxes stay
+  const auto refreshes = sim.get_refreshes();
+  CHECK_EQ(refreshes.size(), 1);
+  if (!refreshes.empty())
+    CHECK(refreshes[0].w <= 32 && refreshes[0].h <= 32);
+  CHECK_EQ(sim.panel(20, 20), 0x00);
+  CHECK_EQ(sim.panel(104, 104), 0x00);
+  CHECK_EQ(sim.panel(120, 104), 0x00);
+  CHECK_EQ(sim.panel(130, 20), 0xFF);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+static void test_registers() {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  auto display = make_display(sim);
+  display->IT8951WriteReg(0x1250, 0x12F0);
+  display->flush_commands_();
+  CHECK_EQ(sim.get_register(0x1250), 0x12F0);
+  CHECK_EQ(display->IT8951ReadReg(0x1250), 0x12F0);
+  CHECK_EQ(display->IT8951ReadReg(LISAR + 2), it8951_sim::Controller::IMAGE_ADDR >> 16);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+static void test_rgb_colors() {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  make_display(sim, [](TestDisplay &it) {
+    it.set_writer([](it8951e &it) {
+      it.fill(esphome::display::COLOR_ON);
+      it.filled_rectangle(10, 10, 20, 20, Color(255, 255, 255));
+      it.filled_rectangle(40, 10, 20, 20, Color(32, 32, 32));
+      it.filled_rectangle(70, 10, 20, 20, Color(200, 200, 200));
+    });
+  })->update();
+  //RGB is light, not ink: white stays paper and dark colors come out dark
+  CHECK_EQ(sim.panel(0, 0), 0x00);
+  CHECK_EQ(sim.panel(15, 15), 0xFF);
+  CHECK(sim.panel(45, 15) < 0x40);
+  CHECK(sim.panel(75, 15) > 0xB0);
+}
+
+/// Pixels the way ESPHome's Image hands them out, opaque grayscale and RGB.
+static void test_image_colors() {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  make_display(sim, [](TestDisplay &it) {
+    it.set_writer([](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      it.draw_pixel_at(10, 10, Color(0x00, 0x00, 0x00, 0xFF));
+      it.draw_pixel_at(11, 10, Color(0x88, 0x88, 0x88, 0xFF));
+      it.draw_pixel_at(12, 10, Color(0xEE, 0xEE, 0xEE, 0xFF));
+      it.draw_pixel_at(13, 10, Color(0xFF, 0xFF, 0xFF, 0xFF));
+      it.draw_pixel_at(14, 10, Color(0xFF, 0x00, 0x00, 0xFF));
+      it.draw_pixel_at(15, 10, Color(0x00, 0xFF, 0x00, 0xFF));
+    });
+  })->update();
+  //Gray goes by luma, opaque white is COLOR_ON and comes out black like on other monochrome displays
+  CHECK_EQ(sim.panel(10, 10), 0x00);
+  CHECK_EQ(sim.panel(11, 10), 0x88);
+  CHECK_EQ(sim.panel(12, 10), 0xEE);
+  CHECK_EQ(sim.panel(13, 10), 0x00);
+  CHECK_EQ(sim.panel(14, 10), 0x44);
+  CHECK_EQ(sim.panel(15, 10), 0x99);
+  CHECK_EQ(sim.panel(16, 10), 0xFF);
+}
+
+static void test_read_clock() {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  auto display = make_display(sim, [](TestDisplay &it) {
+    it.set_read_data_rate(esphome::spi::DATA_RATE_10MHZ);
+    it.set_writer(draw_test_pattern);
+  });
+  //One device per clock, registered once
+  CHECK_EQ(sim.get_stats().device_setups, 2);
+  sim.reset_stats();
+  for (int i = 0; i < 3; i++) {
+    display->update();
+    CHECK(run_until_idle(display.get()));
+    CHECK_EQ(display->IT8951ReadReg(LISAR + 2), it8951_sim::Controller::IMAGE_ADDR >> 16);
+  }
+  CHECK_EQ(sim.get_stats().device_setups, 0);
+  CHECK_EQ(sim.get_stats().read_data_rate, esphome::spi::DATA_RATE_10MHZ);
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+static void test_rotation(DisplayRotation rotation) {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_rotation(rotation);
+    it.set_writer(draw_test_pattern);
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(panel_mismatches(sim, display.get(), rotation), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+static void test_refresh_waits_for_engines() {
+  it8951_sim::Controller sim(PANEL_W, PANEL_H);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      it.filled_rectangle(32, 32, 32, 32, frame % 2 ? esphome::display::COLOR_ON : esphome::display::COLOR_OFF);
+    });
+  });
+  //Back to back updates of the same area, the load must not overwrite pixels a LUT engine still reads
+  for (frame = 0; frame < 4; frame++)
+    display->update();
+  CHECK(run_until_idle(display.get()));
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.get_load_violations(), 0);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+int main() {
+  test_init();
+  test_full_update(1);
+  test_full_update(2);
+  test_full_update(4);
+  test_full_update(8);
+  test_partial_update();
+  test_partial_update(64);
+  test_partial_update(64, 32768);
+  test_tiles_kept(false);
+  test_tiles_kept(true);
+  test_registers();
+  test_rgb_colors();
+  test_image_colors();
+  test_read_clock();
+  test_rotation(esphome::display::DISPLAY_ROTATION_90_DEGREES);
+  test_rotation(esphome::display::DISPLAY_ROTATION_180_DEGREES);
+  test_rotation(esphome::display::DISPLAY_ROTATION_270_DEGREES);
+  test_refresh_waits_for_engines();
+  printf("%s: %d failures\n", __FILE__, test_failures);
+  return test_failures == 0 ? 0 : 1;
+}
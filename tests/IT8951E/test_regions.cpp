@@ -0,0 +1,80 @@
+#include "test_display.h"
+
+#include "esphome/core/hal.h"
+
+// Update regions and min_refresh_interval: what goes out first and what waits.
+
+using esphome::Color;
+using esphome::it8951e::it8951e;
+
+static void test_priority_first() {
+  it8951_sim::Controller sim(256, 192);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.add_region(0, 0, 64, 64, 0, true);
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      const uint8_t v = 255 - frame * 60;
+      it.filled_rectangle(128, 64, 128, 128, Color(v, v, v));
+      it.filled_rectangle(16, 16, 16, 16, Color(v, v, v));
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+
+  frame = 1;
+  sim.clear_refreshes();
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  const auto refreshes = sim.get_refreshes();
+  CHECK_EQ(refreshes.size(), 2);
+  if (refreshes.size() == 2) {
+    //The priority box is refreshed before the big box is even uploaded, 8 KiB take over 3 ms at 20 MHz
+    CHECK(refreshes[0].x < 64 && refreshes[0].y < 64);
+    CHECK(refreshes[1].start_us - refreshes[0].start_us > 3000);
+  }
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+}
+
+static void test_min_interval(bool double_buffer, uint16_t band_height) {
+  it8951_sim::Controller sim(256, 192);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_double_buffer(double_buffer);
+    it.set_band_height(band_height);
+    it.set_min_refresh_interval(1000);
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      it.filled_rectangle(32 + frame * 32, 32, 32, 32, esphome::display::COLOR_ON);
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  const uint64_t first = sim.get_refreshes().back().start_us;
+
+  //Drawn right away, refreshed once the interval is over
+  frame = 1;
+  sim.clear_refreshes();
+  display->update();
+  run_for(display.get(), 200);
+  CHECK_EQ(sim.get_refreshes().size(), 0);
+  CHECK(run_until_idle(display.get()));
+  const auto refreshes = sim.get_refreshes();
+  CHECK(!refreshes.empty());
+  //The interval counts from when the first frame was scheduled, its upload came before its refresh
+  if (!refreshes.empty())
+    CHECK(refreshes[0].start_us - first >= 900 * 1000);
+  if (band_height == 0)
+    CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.panel(70, 40), 0x00);
+  CHECK_EQ(sim.get_bus_errors(), 0);
+}
+
+int main() {
+  test_priority_first();
+  test_min_interval(false, 0);
+  test_min_interval(true, 0);
+  test_min_interval(false, 64);
+  printf("%s: %d failures\n", __FILE__, test_failures);
+  return test_failures == 0 ? 0 : 1;
+}
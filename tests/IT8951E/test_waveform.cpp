@@ -0,0 +1,79 @@
+#include "test_display.h"
+
+// Waveform choice per refreshed area and the grayscale history it relies on.
+
+using esphome::Color;
+using esphome::it8951e::it8951e;
+
+static const uint16_t MODE_DU = 1;
+static const uint16_t MODE_A2 = 6;
+
+/// Black boxes drawn into tile (1, 1) without touching the rest of the frame. The tile may also
+/// hold a gray pixel, which the second box covers and A2 must not be used for.
+static void test_partly_covered_tile(bool gray_neighbour) {
+  it8951_sim::Controller sim(256, 192);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_binary_waveform(esphome::it8951e::BINARY_WAVEFORM_A2);
+    it.set_frame_diff(false);
+    it.set_auto_clear(false);
+    it.set_writer([&](it8951e &it) {
+      if (frame == 0) {
+        it.fill(esphome::display::COLOR_OFF);
+        if (gray_neighbour)
+          it.draw_pixel_at(34, 34, Color(127, 127, 127));
+      } else if (frame == 1) {
+        it.filled_rectangle(44, 44, 8, 8, esphome::display::COLOR_ON);
+      } else {
+        it.filled_rectangle(32, 32, 8, 8, esphome::display::COLOR_ON);
+      }
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+
+  //The first refresh after the full GC16 can't know the tile is binary yet
+  const uint16_t expected[3] = {0, MODE_DU, gray_neighbour ? MODE_DU : MODE_A2};
+  for (frame = 1; frame <= 2; frame++) {
+    sim.clear_refreshes();
+    display->update();
+    CHECK(run_until_idle(display.get()));
+    const auto refreshes = sim.get_refreshes();
+    CHECK_EQ(refreshes.size(), 1);
+    if (!refreshes.empty())
+      CHECK_EQ(refreshes[0].mode, expected[frame]);
+  }
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.get_artifacts(), 0);
+}
+
+/// An area covering whole tiles decides their history on its own.
+static void test_covered_tiles() {
+  it8951_sim::Controller sim(256, 192);
+  int frame = 0;
+  auto display = make_display(sim, [&](TestDisplay &it) {
+    it.set_binary_waveform(esphome::it8951e::BINARY_WAVEFORM_A2);
+    it.set_writer([&](it8951e &it) {
+      it.fill(esphome::display::COLOR_OFF);
+      it.filled_rectangle(64, 64, 64, 64, frame == 1 ? Color(127, 127, 127) : esphome::display::COLOR_ON);
+    });
+  });
+  display->update();
+  CHECK(run_until_idle(display.get()));
+  for (frame = 1; frame <= 3; frame++) {
+    display->update();
+    CHECK(run_until_idle(display.get()));
+  }
+  const uint32_t tile = 2 * display->tiles_x_ + 2;
+  CHECK(!display->gray_tiles_[tile]);
+  CHECK_EQ(panel_mismatches(sim, display.get()), 0);
+  CHECK_EQ(sim.get_artifacts(), 0);
+}
+
+int main() {
+  test_partly_covered_tile(false);
+  test_partly_covered_tile(true);
+  test_covered_tiles();
+  printf("%s: %d failures\n", __FILE__, test_failures);
+  return test_failures == 0 ? 0 : 1;
+}